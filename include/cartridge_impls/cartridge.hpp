@@ -63,13 +63,21 @@ private:
     constexpr static uint8_t ramEnableValue =
             0x0A; // if any other value is written to RAM enable register, RAM is disabled
 
+    // Computed by updateBanks() after register writes
+    unsigned romBankIndices[2] = { 0, 1 }; // 0x0000-0x3FFF and 0x4000-0x7FFF
+    unsigned ramBankIndex      = 0;
+
     unsigned getRomBankIndex( bool isPrimaryRom ) const;
+    void updateBanks();
     uint8_t readRom( const uint16_t address, bool isPrimaryRom ) const;
 
 public:
     MBC1Cartridge( std::vector<uint8_t>&& rom_ );
     uint8_t read( const uint16_t address ) override;
     void write( const uint16_t address, const uint8_t value ) override;
+    unsigned mappedRomBank( const uint16_t address ) const override {
+        return romBankIndices[address < romStartAddress + romBankSize ? 0 : 1];
+    }
     ~MBC1Cartridge() = default;
 };
 
@@ -85,10 +93,18 @@ private:
     uint8_t selectedRomBankRegister = 1;     // 4 bit register for selecting ROM bank
     bool ramEnabled                 = false; // RAM enabled flag
 
+    // Half-byte RAM isn't mapped, Memory reads and writes it through the cartridge
+    void updateBanks() {
+        mapBanks( romBankData( 0 ), romBankData( selectedRomBankRegister ), nullptr );
+    }
+
 public:
     MBC2Cartridge( std::vector<uint8_t>&& rom_ );
     uint8_t read( const uint16_t address ) override;
     void write( const uint16_t address, const uint8_t value ) override;
+    unsigned mappedRomBank( const uint16_t address ) const override {
+        return address < romStartAddress + romBankSize ? 0 : selectedRomBankRegister;
+    }
     ~MBC2Cartridge() = default;
 };
 
@@ -187,6 +203,12 @@ private:
             0x0A; // if any other value is written to RAM enable register, RAM is disabled
 
     uint8_t readRom( const uint16_t address, bool isPrimaryRom ) const;
+    // RTC registers aren't mapped, Memory reads and writes them through the cartridge
+    void updateBanks() {
+        const bool ramMapped = ramAndRtcEnabled && isValueInRamBankRange( ramBankOrRtcSelectRegister );
+        mapBanks( romBankData( 0 ), romBankData( romSelectRegister ),
+                  ramMapped ? ramBankData( ramBankOrRtcSelectRegister ) : nullptr );
+    }
 
     uint8_t romSelectRegister          = 0;
     uint8_t lastLatchWriteValue        = 0; // maybe initialize to 0xFF?
@@ -197,5 +219,8 @@ public:
     MBC3Cartridge( std::vector<uint8_t>&& rom_, bool hasTimer_ = false );
     uint8_t read( const uint16_t address ) override;
     void write( const uint16_t address, const uint8_t value ) override;
+    unsigned mappedRomBank( const uint16_t address ) const override {
+        return address < romStartAddress + romBankSize ? 0 : romSelectRegister;
+    }
     ~MBC3Cartridge() = default;
 };
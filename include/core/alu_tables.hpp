@@ -0,0 +1,120 @@
+#pragma once
+#include "core/core_constants.hpp"
+#include "core/core_utils.hpp"
+#include <array>
+#include <cstdint>
+
+// Results of DAA, the CB prefixed rotates and shifts and BIT, built at compile time.
+// An entry holds the result with the complete Z, N, H and C flags, so an operation is a single load.
+namespace alu {
+struct Result_t {
+    uint8_t value;
+    uint8_t flags; // F, lower nibble zero
+};
+
+// Indexed by CB opcode bits 3-5
+enum class Shift_t : uint8_t { RLC, RRC, RL, RR, SLA, SRA, SWAP, SRL };
+
+constexpr Result_t computeShift( const Shift_t operation, const bool carryIn, const uint8_t value ) {
+    uint8_t result = 0;
+    bool carry     = false;
+    switch( operation ) {
+        using enum Shift_t;
+    case RLC:
+        carry  = value >> 7;
+        result = lsb( ( value << 1 ) | carry );
+        break;
+    case RRC:
+        carry  = value & 0x1;
+        result = lsb( ( value >> 1 ) | ( carry << 7 ) );
+        break;
+    case RL:
+        carry  = value >> 7;
+        result = lsb( ( value << 1 ) | carryIn );
+        break;
+    case RR:
+        carry  = value & 0x1;
+        result = lsb( ( value >> 1 ) | ( carryIn << 7 ) );
+        break;
+    case SLA:
+        carry  = value >> 7;
+        result = lsb( value << 1 );
+        break;
+    case SRA:
+        carry  = value & 0x1;
+        result = lsb( ( value >> 1 ) | ( value & 0x80 ) );
+        break;
+    case SWAP:
+        result = lsb( ( value << 4 ) | ( value >> 4 ) );
+        break;
+    case SRL:
+        carry  = value & 0x1;
+        result = lsb( value >> 1 );
+        break;
+    }
+    return { result, static_cast<uint8_t>( ( ! result ) << 7 | carry << 4 ) };
+}
+
+// Indexed by ( N, H, C ) << 8 | A, the flag bits as they are placed in F shifted by 4
+constexpr Result_t computeDaa( const unsigned index ) {
+    uint8_t registerA  = lsb( index );
+    const bool nFlag   = index & 0x400;
+    const bool hFlag   = index & 0x200;
+    bool cFlag         = index & 0x100;
+    uint8_t adjustment = 0;
+    if( nFlag ) {
+        if( hFlag )
+            adjustment += 6;
+        if( cFlag )
+            adjustment += 0x60;
+        registerA = lsb( registerA - adjustment );
+    } else {
+        if( hFlag || ( registerA & 0xF ) > 9 )
+            adjustment += 6;
+        if( cFlag || registerA > 0x99 ) {
+            adjustment += 0x60;
+            cFlag = true;
+        }
+        registerA = lsb( registerA + adjustment );
+    }
+    return { registerA, static_cast<uint8_t>( ( ! registerA ) << 7 | nFlag << 6 | cFlag << 4 ) };
+}
+
+inline constexpr auto shiftTable = [] {
+    std::array<std::array<Result_t, 512>, 8> table {};
+    for( unsigned operation = 0; operation < 8; operation++ )
+        for( unsigned index = 0; index < 512; index++ )
+            table[operation][index] =
+                    computeShift( static_cast<Shift_t>( operation ), index & 0x100, lsb( index ) );
+    return table;
+}();
+
+inline constexpr auto daaTable = [] {
+    std::array<Result_t, 2048> table {};
+    for( unsigned index = 0; index < 2048; index++ )
+        table[index] = computeDaa( index );
+    return table;
+}();
+
+// Z, N and H of BIT, indexed by bit << 8 | value
+inline constexpr auto bitTable = [] {
+    std::array<uint8_t, 2048> table {};
+    for( unsigned index = 0; index < 2048; index++ ) {
+        const bool bitSet = index & ( 1 << ( index >> 8 ) );
+        table[index]      = static_cast<uint8_t>( ( ! bitSet ) << 7 | bitMask::halfCarryFlag );
+    }
+    return table;
+}();
+
+// flags is the current F, only C is used
+inline Result_t shift( const Shift_t operation, const uint8_t value, const uint8_t flags ) {
+    return shiftTable[static_cast<uint8_t>( operation )][( flags & bitMask::carryFlag ) << 4 | value];
+}
+inline Result_t daa( const uint8_t registerA, const uint8_t flags ) {
+    return daaTable[( flags & 0x70 ) << 4 | registerA];
+}
+// Returns the new F, C stays as it is in flags
+inline uint8_t bit( const unsigned bitIndex, const uint8_t value, const uint8_t flags ) {
+    return static_cast<uint8_t>( bitTable[bitIndex << 8 | value] | ( flags & bitMask::carryFlag ) );
+}
+} // namespace alu
@@ -1,9 +1,13 @@
 #pragma once
+#include "core/interrupt_controller.hpp"
 #include "core/ppu_types.hpp"
 #include <cstdint>
 
 class IBus {
 public:
+    // Implementations keep it in sync with writes of IE and IF
+    InterruptController interrupts;
+
     virtual ~IBus() = default;
 
     virtual uint8_t read( uint16_t address ) const                           = 0;
@@ -13,4 +17,18 @@ public:
     virtual SpriteAttribute getSpriteAttribute( uint8_t sprite_index ) const = 0;
     virtual uint8_t directMemRead( uint16_t address ) const                  = 0;
     virtual void directMemWrite( uint16_t address, uint8_t value )           = 0;
+    virtual unsigned mappedRomBank( uint16_t address ) const                 = 0;
+    // T-cycles in which no enabled interrupt can be requested, 0 if unknown
+    virtual unsigned cyclesUntilInterruptRequest() const                     = 0;
+
+    // Storage of the 256 byte page holding address as read() sees it, which the CPU fetches instructions
+    // from while *version stays the same. data is nullptr when reads of the page have to go through read(),
+    // version when the bus doesn't map pages at all.
+    struct FetchPage {
+        const uint8_t* data     = nullptr;
+        const unsigned* version = nullptr;
+    };
+    virtual FetchPage fetchPage( [[maybe_unused]] uint16_t address ) const {
+        return {};
+    }
 };
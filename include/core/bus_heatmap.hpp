@@ -0,0 +1,35 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Reads and writes per 256 byte page and requester, counted by Emulator in BUS_PROFILING build.
+// Skipped idle loop iterations aren't counted, bulk loops count as the CPU accesses they replace.
+// CPUs caching decoded code ( CachedCpu, JitCpu ) don't fetch executed instructions through the bus.
+class BusHeatmap {
+public:
+    enum Requester_t : uint8_t { CPU, PPU, DMA, TIMER, REQUESTER_COUNT };
+    struct Counter {
+        uint64_t reads  = 0;
+        uint64_t writes = 0;
+    };
+    // Indexed by requester, then by page
+    std::array<std::array<Counter, 256>, REQUESTER_COUNT> pages {};
+
+    // Accesses of count consecutive addresses from address
+    void countRead( const Requester_t requester, const uint16_t address, const std::size_t count = 1 ) {
+        for( std::size_t i = 0; i < count; i++ )
+            pages[requester][( ( address + i ) >> 8 ) & 0xFF].reads++;
+    }
+    void countWrite( const Requester_t requester, const uint16_t address, const std::size_t count = 1 ) {
+        for( std::size_t i = 0; i < count; i++ )
+            pages[requester][( ( address + i ) >> 8 ) & 0xFF].writes++;
+    }
+    void reset() {
+        *this = {};
+    }
+
+    // 256 rows, one per page, columns: page, then reads and writes of every requester
+    std::string toCsv() const;
+};
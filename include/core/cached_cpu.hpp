@@ -0,0 +1,176 @@
+#pragma once
+#include "core/bus.hpp"
+#include "core/fast_cpu.hpp"
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+// FastCpu executing from a cache of translated basic blocks.
+// A block is a straight-line run of instructions with pre-resolved handlers and operand bytes, keyed by
+// ( mapped ROM bank, PC ), so re-executed code skips memory reads and decoding.
+// Built on FastCpu rather than the micro-operation Cpu, which doesn't use the cache, so tick() executes
+// a whole instruction or fused sequence and returns its T-cycles. Emulator::tick() returns them, plus those
+// of skipped idle and bulk loop iterations. Callers can't count on one M-cycle per Emulator::tick().
+// Code is cached from ROM, work RAM and high RAM. Emulator reports every bus write through notifyWrite(),
+// writes to MBC registers refresh the mapped banks and writes to cached RAM code drop the affected blocks.
+// Side-effect-free blocks looping while LY, STAT or IF stays the same are marked as idle loops,
+// Emulator skips their iterations up to the point where the polled register can change.
+// Common instruction sequences are fused and executed in one tick(), see Fusion_t. Loops copying or filling
+// memory byte by byte are marked as bulk loops, Emulator does their iterations as one memcpy or memset.
+class CachedCpu : public FastCpu {
+public:
+    // Sequence starting at an instruction, executed at once when no interrupt can come in between
+    // and no IO or VRAM access happens after its first M-cycle, so the state and cycles stay the same
+    enum class Fusion_t : uint8_t {
+        NONE,
+        COPY_HL_TO_DE, // LD A, (HL+); LD (DE), A
+        DEC_BC_LOOP,   // DEC BC; LD A, B; OR C; JR NZ, imm8
+        LDH_CP,        // LDH A, (imm8); CP imm8
+    };
+    struct CachedInstruction {
+        Handler_t handler;
+        uint16_t address;
+        uint16_t opcode;      // 0x100 | second byte for CB prefixed opcodes
+        uint8_t opcodeLength; // 2 for CB prefixed opcodes
+        uint8_t operands[2];
+        Fusion_t fusion = Fusion_t::NONE;
+    };
+    // Loop branching back to its start with JR NZ, which moves one byte per iteration
+    enum class BulkLoop_t : uint8_t {
+        NONE,
+        COPY_BC, // LD A, (HL+); LD (DE), A; INC DE; DEC BC; LD A, B; OR C
+        COPY_R8, // LD A, (HL+); LD (DE), A; INC DE; DEC B or DEC C
+        FILL_R8, // LD (HL+), A; DEC B or DEC C
+    };
+    struct Block {
+        std::vector<CachedInstruction> instructions;
+        unsigned executions     = 0;
+        const void* compiled    = nullptr; // native translation of a backend ( JitCpu )
+        unsigned compiledCycles = 0;       // T-cycles of the longest run through compiled
+        // IO register polled when the block is an idle loop branching back to its start, 0 otherwise
+        uint16_t polledAddress = 0;
+        BulkLoop_t bulkLoop    = BulkLoop_t::NONE;
+        Operand_t bulkCounter  = Operand_t::b; // B or C of COPY_R8 and FILL_R8
+        // Of an idle or bulk loop iteration branching back
+        unsigned iterationCycles = 0;
+    };
+    // Iterations of a bulk loop which can be done at once
+    struct BulkTransfer {
+        uint16_t source;      // HL, unused by fills
+        uint16_t destination; // DE, HL for fills
+        bool fill;
+        uint8_t value;       // A for fills
+        unsigned iterations; // left before the last one, with no interrupt dispatched in between
+        unsigned iterationCycles;
+    };
+
+protected:
+    static constexpr unsigned maxBlockLength = 32;
+    // Number of immediate bytes after the opcode, CB prefixed opcodes have none
+    static constexpr uint8_t operandLength( const uint8_t opcode ) {
+        switch( opcode ) {
+        case 0x01:
+        case 0x08:
+        case 0x11:
+        case 0x21:
+        case 0x31:
+        case 0xC2:
+        case 0xC3:
+        case 0xC4:
+        case 0xCA:
+        case 0xCC:
+        case 0xCD:
+        case 0xD2:
+        case 0xD4:
+        case 0xDA:
+        case 0xDC:
+        case 0xEA:
+        case 0xFA:
+            return 2;
+        case 0x18:
+        case 0x20:
+        case 0x28:
+        case 0x30:
+        case 0x38:
+        case 0xE0:
+        case 0xE8:
+        case 0xF0:
+        case 0xF8:
+            return 1;
+        default:
+            if( ( opcode & 0xC7 ) == 0x06 || ( opcode & 0xC7 ) == 0xC6 ) // LD r8, imm8 and ALU A, imm8
+                return 1;
+            return 0;
+        }
+    }
+
+    // RAM code is invalidated with this granularity, it keeps IO registers apart from high RAM
+    static constexpr uint16_t chunkSize = 128;
+
+    std::unordered_map<uint32_t, Block> blocks;
+    // Keys of blocks overlapping each chunk of 0x8000-0xFFFF, ROM code is never written
+    std::array<std::vector<uint32_t>, 0x8000 / chunkSize> chunkBlocks;
+    unsigned romBanks[2]; // mapped to 0x0000-0x3FFF and 0x4000-0x7FFF
+
+    // Position in the block being executed, equal when the next instruction has to be looked up
+    const CachedInstruction* cursor   = nullptr;
+    const CachedInstruction* blockEnd = nullptr;
+    // Bumped whenever blocks are dropped or the mapped banks refreshed
+    unsigned invalidations = 0;
+
+    // Idle or bulk loop entered last and the value of its polled register then, nullptr after any other block
+    const Block* spinningBlock = nullptr;
+    uint8_t spinningValue      = 0;
+
+    uint32_t blockKey( uint16_t address ) const {
+        if( address < 0x8000 )
+            return ( romBanks[address >> 14] << 16 ) | address;
+        return address;
+    }
+    // Returns nullptr when code at address can't be cached
+    Block* findBlock( uint16_t address );
+    // Points cursor to the block at address, on nullptr the instruction has to be executed uncached
+    Block* enterBlock( uint16_t address );
+    void translateBlock( uint16_t address, Block& block );
+    static void detectIdleLoop( uint16_t address, Block& block );
+    static void detectFusions( Block& block );
+    static void detectBulkLoop( uint16_t address, Block& block );
+    void refreshRomBanks();
+    // No interrupt can be dispatched within tCycles from now
+    bool interruptFreeFor( unsigned tCycles ) const;
+    // Returns 0 when the sequence at cursor has to be executed instruction by instruction
+    unsigned executeFused();
+    unsigned executeCachedInstruction();
+
+public:
+    // Off switch for ROMs whose polling loops turn out to depend on something not modelled
+    bool idleLoopSkipping = true;
+    // Statistics of skipped idle loop iterations
+    uint64_t skippedIdleCycles     = 0;
+    uint64_t skippedIdleIterations = 0;
+    // Off switch of instruction fusion and number of sequences executed fused
+    bool fusion             = true;
+    uint64_t fusedSequences = 0;
+    // Off switch of bulk loop transfers and number of bytes they moved
+    bool bulkTransfers            = true;
+    uint64_t bulkTransferredBytes = 0;
+
+    void notifyWrite( uint16_t address );
+    void flushBlocks();
+
+    // Idle loop to be entered again with its polled register unchanged since the previous iteration and
+    // no interrupt to dispatch, so further iterations leave the CPU as it is, nullptr otherwise
+    const Block* idleLoop() const;
+    // Accounts iterations of idleLoop() which Emulator skipped
+    void skipIdleIterations( unsigned count );
+    // Bulk loop to be entered again, nullopt when the CPU isn't in one or its remaining iterations
+    // have to be executed
+    std::optional<BulkTransfer> bulkTransfer() const;
+    // Leaves registers as count iterations of bulkTransfer() would, after Emulator moved their bytes
+    void skipBulkIterations( unsigned count );
+
+    CachedCpu( IBus& bus_ );
+    unsigned tick();
+};
@@ -1,5 +1,8 @@
 #pragma once
+#include <array>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <span>
 #include <type_traits>
 #include <utility>
@@ -17,6 +20,9 @@ public:
     enum class RamSizeByte : uint8_t;
     enum class RamSize : unsigned;
 
+    // 0x0000-0x3FFF, 0x4000-0x7FFF and 0xA000-0xBFFF
+    enum class Region_t : uint8_t { ROM_00, ROM_0N, EXTERNAL_RAM };
+
 private:
     RomSize romSize { 0 };
     bool isValidRomSize( RomSizeByte size );
@@ -29,10 +35,16 @@ private:
     void setRamSize( const RamSizeByte size );
 
     std::vector<uint8_t> rom;
+    std::vector<uint8_t> ram; // all banks in one allocation
+
+    std::array<uint8_t*, 3> mappedBanks {};
+    std::function<void()> bankListener;
 
 protected:
     std::vector<std::span<uint8_t>> romBanks;
-    std::vector<std::vector<uint8_t>> ramBanks;
+    std::vector<std::span<uint8_t>> ramBanks;
+    // Zeroed RAM of bankCount banks, replaces the previous one
+    void allocateRam( std::size_t bankCount, std::size_t bankSize );
 
     constexpr static uint16_t romBankSize     = 0x4000;  // 16 KiB
     constexpr static uint16_t romStartAddress = 0x0000;  // Start address for ROM bank
@@ -65,6 +77,18 @@ protected:
 
     constexpr static uint8_t invalidReadValue = 0xFF; // Value returned on invalid read
 
+    // Storage of a ROM bank, nullptr when the bank doesn't exist or the ROM file is shorter
+    uint8_t* romBankData( const unsigned bank ) const {
+        if( bank >= romBanks.size() || ( bank + 1 ) * std::size_t { romBankSize } > rom.size() )
+            return nullptr;
+        return romBanks[bank].data();
+    }
+    uint8_t* ramBankData( const unsigned bank ) {
+        return bank < ramBanks.size() ? ramBanks[bank].data() : nullptr;
+    }
+    // Publishes the banks mapped after a register write, notifies the listener when they changed
+    void mapBanks( uint8_t* rom00, uint8_t* rom0N, uint8_t* externalRam );
+
     constexpr static uint8_t nintendoCopyrightHeader[] = {
             0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0D, 0x00, 0x0B, 0x03, 0x73, 0x00, 0x83, 0x00, 0x0C, 0x00, 0x0D,
             0x00, 0x08, 0x11, 0x1F, 0x88, 0x89, 0x00, 0x0E, 0xDC, 0xCC, 0x6E, 0xE6, 0xDD, 0xDD, 0xD9, 0x99,
@@ -79,6 +103,20 @@ public:
     virtual uint8_t read( const uint16_t address )                    = 0;
     virtual void write( const uint16_t address, const uint8_t value ) = 0;
     virtual ~CoreCartridge()                                          = default;
+
+    // Index of the ROM bank currently visible at the given ROM address
+    virtual unsigned mappedRomBank( const uint16_t address ) const {
+        return address < romStartAddress + romBankSize ? 0 : 1;
+    }
+    // Storage of the bank mapped to the region, which Memory accesses directly ( external RAM both ways ).
+    // nullptr when accesses have to go through read() and write(), e.g. disabled RAM or RTC registers.
+    uint8_t* mappedBank( const Region_t region ) const {
+        return mappedBanks[std::to_underlying( region )];
+    }
+    // Called whenever a register write changes what mappedBank() returns
+    void setBankListener( std::function<void()> listener ) {
+        bankListener = std::move( listener );
+    }
 };
 
 enum class CoreCartridge::CartridgeType : uint8_t {
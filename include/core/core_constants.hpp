@@ -54,6 +54,7 @@ constexpr uint16_t bgScrollY    = 0xFF42;
 constexpr uint16_t bgScrollX    = 0xFF43;
 constexpr uint16_t lcdY         = 0xFF44;
 constexpr uint16_t lyc          = 0xFF45;
+constexpr uint16_t oamDma       = 0xFF46;
 constexpr uint16_t winY         = 0xFF4A;
 constexpr uint16_t winX         = 0xFF4B;
 // Registers - non-CGB mode only
@@ -121,6 +122,9 @@ constexpr uint16_t videoRam = 8192;
 // other
 namespace constant {
 constexpr unsigned tickrate        = 4'194'304;
+constexpr unsigned frameDuration   = 70'224; // T-cycles, 154 scanlines
+constexpr unsigned oamDmaDuration  = 640;    // T-cycles, 160 M-cycles
 constexpr double oscillatoryTime   = 1.0 / tickrate;
 constexpr uint8_t invalidReadValue = 0xFF;
+constexpr unsigned cacheLineSize   = 64; // bytes, hot state is aligned and packed to it
 } // namespace constant
@@ -2,8 +2,13 @@
 #include "core/bus.hpp"
 #include "core/core_utils.hpp"
 #include "core/cycles.hpp"
+#include "core/execution_profile.hpp"
 #include <array>
+#include <bit>
 #include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <utility>
 #include <variant>
 
 template<typename T>
@@ -130,8 +135,8 @@ public:
         h,
         l,
         phl,
-        a = 7, // sixth in registers array but encoded by 7 in opcodes
-        f, // f is seventh in registers array and never encoded by opcode
+        a = 7, // encoded by 7 in opcodes
+        f, // never encoded by opcode
         // r16
         bc = 0,
         de,
@@ -155,74 +160,250 @@ public:
     //In case of IMM8 and IMM16, don't save the next byte(s)
     //They will be fetched in execution phase
     using OperandVar_t = std::variant<std::monostate, Operand_t, uint8_t>;
+    struct MicroOperation_t;
+    // Executes the micro-operation it is called with, see handlerOf()
+    using MopHandler_t = void ( * )( Cpu& cpu, MicroOperation_t mop );
     struct MicroOperation_t {
         MicroOperationType_t type;
         Operand_t operand1;
         Operand_t operand2;
-        MicroOperation_t( MicroOperationType_t type_ = MicroOperationType_t::END,
-                          Operand_t operand1_ = Operand_t::NONE, Operand_t operand2_ = Operand_t::NONE )
+        MopHandler_t handler; // generic one, the decoded opcode table holds operand-specialised ones
+        constexpr MicroOperation_t( MicroOperationType_t type_ = MicroOperationType_t::END,
+                                    Operand_t operand1_ = Operand_t::NONE,
+                                    Operand_t operand2_ = Operand_t::NONE )
             : type( type_ )
             , operand1( operand1_ )
-            , operand2( operand2_ ) {
+            , operand2( operand2_ )
+            , handler( &executeMop ) {
         }
     };
     // This is max amount of microcodes in instruction + 1 (for terminator)
     using MicroOperations_t = std::array<MicroOperation_t, 7>;
 
 protected:
-    // Default values of registers are for DMG; register f is initialized in constructor
-    uint8_t registers[8] { 0x0, 0x13, 0x0, 0xD8, 0x1, 0x4D, 0x1 }; //b,c,d,e,h,l,a,f
-    uint8_t Z, W;                                                  // temporary registers
+    // Pairs BC, DE, HL and AF are stored in host byte order, so a pair takes one 16-bit load or store and
+    // a single register one 8-bit load or store at r8Index. Offsets of the more and less significant register:
+    static constexpr uint8_t msbOffset = std::endian::native == std::endian::big ? 0 : 1;
+    static constexpr uint8_t lsbOffset = 1 - msbOffset;
+    static constexpr uint8_t aIndex    = 6 + msbOffset, fIndex = 6 + lsbOffset;
+    // Index in registers by r8 encoding: b, c, d, e, h, l, (hl) ( unused ), a, f
+    static constexpr uint8_t r8Index[9] = { msbOffset,     lsbOffset, 2 + msbOffset, 2 + lsbOffset, 4 + msbOffset,
+                                            4 + lsbOffset, 0,         aIndex,        fIndex };
+    static constexpr uint8_t msbIndex( const unsigned pair ) {
+        return static_cast<uint8_t>( 2 * pair + msbOffset );
+    }
+    static constexpr uint8_t lsbIndex( const unsigned pair ) {
+        return static_cast<uint8_t>( 2 * pair + lsbOffset );
+    }
+    // State used by every M-cycle, kept within one cache line
+    // Initialized to DMG values in constructor
+    alignas( constant::cacheLineSize ) uint8_t registers[8];
+    uint8_t Z, W; // temporary registers
     uint16_t SP = 0xFFFE, PC = 0x100;
-    IBus& bus;
     bool interruptMasterEnabled = false;
     bool enableIMELater         = false;
     bool halted                 = false;
     bool lastConditionCheck     = false;
-    MicroOperations_t mopQueue  = { MicroOperationType_t::NOP };
     unsigned atMicroOperationNr = 0;
+    // Points into the pre-decoded instruction table ( or one of the sequences below ), terminated by END
+    const MicroOperation_t* mopQueue;
+    IBus& bus;
+    // Page of the last instruction fetch, so sequential fetches don't call the bus. Valid while the bus
+    // doesn't remap its pages ( bank switches, VRAM and OAM locks ).
+    struct {
+        const uint8_t* data     = nullptr;
+        const unsigned* version = nullptr;
+        unsigned validVersion   = 0;
+        unsigned page           = 0x100; // none
+    } fetchWindow;
+
+    // Read of an opcode or immediate byte
+    uint8_t fetchByte( const uint16_t address ) {
+        if( address >> 8 == fetchWindow.page && *fetchWindow.version == fetchWindow.validVersion ) [[likely]]
+            return fetchWindow.data ? fetchWindow.data[address & 0xFF] : bus.read( address );
+        return fetchSlow( address );
+    }
+    uint8_t fetchSlow( uint16_t address );
+
+    static const MicroOperation_t emptyMopQueue[1];
+
+#ifdef CPU_PROFILING
+    ExecutionProfile profile;
+    // Opcode charged with the M-cycles of its micro-operations, noProfiledOpcode during interrupt dispatch
+    static constexpr uint16_t noProfiledOpcode = 0xFFFF;
+    uint16_t profiledOpcode                    = noProfiledOpcode;
+#endif
+
+    // Requested interrupts which are enabled, regardless of IME
+    uint8_t pendingInterrupts() const {
+        return bus.interrupts.pending();
+    }
+
+    // r16 encoding except SP, or 3 for AF
+    uint16_t readPair( const unsigned pair ) const {
+        uint16_t value;
+        std::memcpy( &value, &registers[2 * pair], sizeof( value ) );
+        return value;
+    }
+    void writePair( const unsigned pair, const uint16_t value ) {
+        std::memcpy( &registers[2 * pair], &value, sizeof( value ) );
+    }
 
 public:
-    uint8_t readR8( Operand_t opd );
-    uint16_t readR16( Operand_t opd );
+    uint8_t readR8( Operand_t opd ) {
+#ifdef LAZY_FLAGS
+        if( opd == Operand_t::f ) [[unlikely]]
+            return flags();
+#endif
+        return registers[r8Index[std::to_underlying( opd )]];
+    }
+    uint16_t readR16( Operand_t opd ) {
+        if( opd == Operand_t::sp )
+            return SP;
+        return readPair( std::to_underlying( opd ) );
+    }
 
-    void writeR8( Operand_t opd, uint8_t value );
-    void writeR16( Operand_t opd, uint16_t value );
+    void writeR8( Operand_t opd, uint8_t value ) {
+        if( opd == Operand_t::f ) [[unlikely]]
+            materializeFlags(); // drops pending lazy flags
+        registers[r8Index[std::to_underlying( opd )]] = value;
+    }
+    void writeR16( Operand_t opd, uint16_t value ) {
+        if( opd == Operand_t::sp )
+            SP = value;
+        else
+            writePair( std::to_underlying( opd ), value );
+    }
 
     uint8_t addU8ToU8( uint8_t value, uint8_t value2 );
-    void addToR8( Operand_t operand, uint8_t value );
-    void subFromR8( Operand_t operand, uint8_t value, bool discard = false );
+    void addToR8( Operand_t operand, uint8_t value ) {
+        const auto currentValue = readR8( operand );
+        writeR8( operand, static_cast<uint8_t>( currentValue + value ) );
+        setFlagsOf( FlagsOperation_t::ADD, currentValue, value );
+    }
+    void subFromR8( Operand_t operand, uint8_t value, bool discard = false ) {
+        const auto currentValue = readR8( operand );
+        if( ! discard )
+            writeR8( operand, static_cast<uint8_t>( currentValue - value ) );
+        setFlagsOf( FlagsOperation_t::SUB, currentValue, value );
+    }
 
     void execute( MicroOperation_t mop );
+    static void executeMop( Cpu& cpu, MicroOperation_t mop ) {
+        cpu.execute( mop );
+    }
+    // Micro-operations on r8 registers ( and bit index ), defined in cpu_operand_handlers.hpp.
+    // execute() passes operands known at run time, executeSpecialised() constant ones.
+    template<MicroOperationType_t type>
+    void executeR8( Operand_t operand1, Operand_t operand2 );
+    template<MicroOperationType_t type, Operand_t operand1, Operand_t operand2>
+    static void executeSpecialised( Cpu& cpu, MicroOperation_t mop );
+    // Handler specialised for the operands of mop, executeMop if there is none
+    static constexpr MopHandler_t handlerOf( MicroOperation_t mop );
     bool handleInterrupts();
+    // Puts the vector of the highest priority pending interrupt into WZ and acknowledges it
+    bool acceptInterrupt();
     bool isConditionMet( Operand_t condition ) const;
 
-    MicroOperations_t decode();
-    //helpers
-    MicroOperations_t decodeBlock0( const uint8_t opcode );
-    MicroOperations_t decodeBlock2( const uint8_t opcode );
-    MicroOperations_t decodeBlock3( const uint8_t opcode );
-    MicroOperations_t decodeCB();
+    // Fetches the opcode and returns its micro-operations from the table built at compile time
+    const MicroOperation_t* decode();
+    //helpers - only evaluated at compile time to build the table
+    static constexpr MicroOperations_t decodeOpcode( const uint8_t opcode );
+    static constexpr MicroOperations_t decodeBlock0( const uint8_t opcode );
+    static constexpr MicroOperations_t decodeBlock2( const uint8_t opcode );
+    static constexpr MicroOperations_t decodeBlock3( const uint8_t opcode );
+    static constexpr MicroOperations_t decodeCB( const uint8_t opcodeSecondByte );
     // clang-format off
     uint16_t getWZ() { return static_cast<uint16_t>( ( W << 8 ) | Z ); }
     void setWZ( uint16_t value ) { Z = lsb(value); W = msb( value  ); }
 
-    bool isPHL( Operand_t operand ) const { return operand == Operand_t::phl; }
-    bool getZFlag() const { return registers[7] &( 1 << 7 ); } // Zero flag
-    bool getNFlag() const { return registers[7] &( 1 << 6 ); } // BDC substraction flag
-    bool getHFlag() const { return registers[7] &( 1 << 5 ); } // BDC half carry flag
-    bool getCFlag() const { return registers[7] &( 1 << 4 ); } // Carry flag
+    static constexpr bool isPHL( Operand_t operand ) { return operand == Operand_t::phl; }
+    bool getZFlag() const { return flags() &( 1 << 7 ); } // Zero flag
+    bool getNFlag() const { return flags() &( 1 << 6 ); } // BDC substraction flag
+    bool getHFlag() const { return flags() &( 1 << 5 ); } // BDC half carry flag
+    bool getCFlag() const { return flags() &( 1 << 4 ); } // Carry flag
 
-    void setZFlag( bool val ) { registers[7] = static_cast<uint8_t>(val ? registers[7] | ( 1 << 7 ) : registers[7] & ~( 1 << 7 )); }
-    void setNFlag( bool val ) { registers[7] = static_cast<uint8_t>(val ? registers[7] | ( 1 << 6 ) : registers[7] & ~( 1 << 6 )); }
-    void setHFlag( bool val ) { registers[7] = static_cast<uint8_t>(val ? registers[7] | ( 1 << 5 ) : registers[7] & ~( 1 << 5 )); }
-    void setCFlag( bool val ) { registers[7] = static_cast<uint8_t>(val ? registers[7] | ( 1 << 4 ) : registers[7] & ~( 1 << 4 )); }
+    void setZFlag( bool val ) { materializeFlags(); registers[fIndex] = static_cast<uint8_t>(val ? registers[fIndex] | ( 1 << 7 ) : registers[fIndex] & ~( 1 << 7 )); }
+    void setNFlag( bool val ) { materializeFlags(); registers[fIndex] = static_cast<uint8_t>(val ? registers[fIndex] | ( 1 << 6 ) : registers[fIndex] & ~( 1 << 6 )); }
+    void setHFlag( bool val ) { materializeFlags(); registers[fIndex] = static_cast<uint8_t>(val ? registers[fIndex] | ( 1 << 5 ) : registers[fIndex] & ~( 1 << 5 )); }
+    void setCFlag( bool val ) { materializeFlags(); registers[fIndex] = static_cast<uint8_t>(val ? registers[fIndex] | ( 1 << 4 ) : registers[fIndex] & ~( 1 << 4 )); }
     // clang-format on
+    // Sets Z, N, H and C to the upper nibble of znhc, laid out as in F
+    void setFlags( const uint8_t znhc ) {
+#ifdef LAZY_FLAGS
+        lazyFlags.operation = FlagsOperation_t::NONE;
+#endif
+        registers[fIndex] = static_cast<uint8_t>( ( registers[fIndex] & 0xF ) | ( znhc & 0xF0 ) );
+    }
     void setZNHCFlags( bool Z, bool N, bool H, bool C ) {
-        setZFlag( Z );
-        setNFlag( N );
-        setHFlag( H );
-        setCFlag( C );
+        setFlags( static_cast<uint8_t>( Z << 7 | N << 6 | H << 5 | C << 4 ) );
+    }
+
+    // Operations whose flags follow from their operands alone
+    enum class FlagsOperation_t : uint8_t {
+        NONE,
+        ADD, // left + right + carry
+        SUB, // left - right - carry
+        AND, // result in left
+        OR,  // OR and XOR, result in left
+    };
+    static constexpr uint8_t flagsOf( const FlagsOperation_t operation, const uint8_t left,
+                                      const uint8_t right, const uint8_t carry ) {
+        switch( operation ) {
+            using enum FlagsOperation_t;
+        case ADD: {
+            const unsigned result = left + right + carry;
+            const bool halfCarry  = ( left & 0xF ) + ( right & 0xF ) + carry > 0xF;
+            return static_cast<uint8_t>( ! lsb( result ) << 7 | halfCarry << 5 | ( result > 0xFF ) << 4 );
+        }
+        case SUB: {
+            const int result     = left - right - carry;
+            const bool halfCarry = ( left & 0xF ) - ( right & 0xF ) - carry < 0;
+            return static_cast<uint8_t>( ! lsb( result ) << 7 | 1 << 6 | halfCarry << 5 |
+                                         ( result < 0 ) << 4 );
+        }
+        case AND:
+            return static_cast<uint8_t>( ! left << 7 | 1 << 5 );
+        case OR:
+            return static_cast<uint8_t>( ! left << 7 );
+        default:
+            return 0;
+        }
+    }
+#ifdef LAZY_FLAGS
+    // Lazy flags: operation setting all flags from its operands records them here, registers[fIndex] is stale
+    // until flags are read ( flag getters, PUSH AF, DAA, conditions ) and materialised
+    struct {
+        FlagsOperation_t operation = FlagsOperation_t::NONE;
+        uint8_t left, right, carry;
+    } lazyFlags;
+#endif
+    // Sets Z, N, H and C according to operation, evaluated only when needed in LAZY_FLAGS build
+    void setFlagsOf( const FlagsOperation_t operation, const uint8_t left, const uint8_t right = 0,
+                     const uint8_t carry = 0 ) {
+#ifdef LAZY_FLAGS
+        lazyFlags = { operation, left, right, carry };
+#else
+        registers[fIndex] =
+                static_cast<uint8_t>( ( registers[fIndex] & 0xF ) | flagsOf( operation, left, right, carry ) );
+#endif
+    }
+    // Value of F register
+    uint8_t flags() const {
+#ifdef LAZY_FLAGS
+        if( lazyFlags.operation != FlagsOperation_t::NONE )
+            return static_cast<uint8_t>( ( registers[fIndex] & 0xF ) |
+                                         flagsOf( lazyFlags.operation, lazyFlags.left, lazyFlags.right,
+                                                  lazyFlags.carry ) );
+#endif
+        return registers[fIndex];
+    }
+    // Stores pending lazy flags to registers[fIndex], for code accessing it directly
+    void materializeFlags() {
+#ifdef LAZY_FLAGS
+        registers[fIndex]   = flags();
+        lazyFlags.operation = FlagsOperation_t::NONE;
+#endif
     }
 
     void logOperation( MicroOperation_t mop );
@@ -231,4 +412,29 @@ public:
     Cpu( IBus& bus_ );
     ~Cpu() = default;
     unsigned tick();
+    // HALT lasts until an enabled interrupt is requested, till then ticks don't change the CPU
+    bool waitsForInterrupt() const {
+        return halted && ! pendingInterrupts();
+    }
+    uint16_t getPC() const {
+        return PC;
+    }
+    // The next tick decodes the instruction at PC, unless it dispatches an interrupt
+    bool atInstructionStart() const {
+        return mopQueue[atMicroOperationNr].type == MicroOperationType_t::END;
+    }
+    // Next fetch asks the bus for its page again, for buses whose fetchPage() changes without a remap
+    void dropFetchWindow() {
+        fetchWindow.page = 0x100;
+    }
+    // Defined in DEBUG and CPU_PROFILING builds
+    static std::string_view microOperationName( MicroOperationType_t type );
+#ifdef CPU_PROFILING
+    const ExecutionProfile& executionProfile() const {
+        return profile;
+    }
+    void resetExecutionProfile() {
+        profile.reset();
+    }
+#endif
 };
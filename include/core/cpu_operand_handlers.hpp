@@ -0,0 +1,186 @@
+#pragma once
+#include "core/alu_tables.hpp"
+#include "core/core_utils.hpp"
+#include "core/cpu.hpp"
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <utility>
+
+// Shared by execute() and the handlers of the decoded opcode table. With constant operands, as in
+// executeSpecialised(), register indices and the check for F in readR8() and writeR8() fold away.
+template<Cpu::MicroOperationType_t type>
+void Cpu::executeR8( const Operand_t operand1, [[maybe_unused]] const Operand_t operand2 ) {
+    using enum MicroOperationType_t;
+    if constexpr( type == LD_Z_TO_R8 ) {
+        writeR8( operand1, Z );
+    } else if constexpr( type == INC_R8 ) {
+        const bool cFlag = getCFlag();
+        addToR8( operand1, 1 );
+        setCFlag( cFlag );
+    } else if constexpr( type == DEC_R8 ) {
+        const bool cFlag = getCFlag();
+        subFromR8( operand1, 1 );
+        setCFlag( cFlag );
+    } else if constexpr( type == LD_R8_TO_R8 ) {
+        const uint8_t value = readR8( operand2 );
+        writeR8( operand1, value );
+    } else if constexpr( type == LD_R8_TO_pHL ) {
+        bus.write( readR16( Operand_t::hl ), readR8( operand1 ) );
+    } else if constexpr( type == ALU_ADD_R8_TO_A ) {
+        addToR8( Operand_t::a, readR8( operand1 ) );
+    } else if constexpr( type == ALU_ADC_R8_TO_A ) {
+        addToR8( Operand_t::a, getCFlag() + readR8( operand1 ) );
+    } else if constexpr( type == ALU_SUB_R8_FROM_A ) {
+        subFromR8( Operand_t::a, readR8( operand1 ) );
+    } else if constexpr( type == ALU_SBC_R8_FROM_A ) {
+        subFromR8( Operand_t::a, getCFlag() + readR8( operand1 ) );
+    } else if constexpr( type == ALU_A_AND_R8 ) {
+        const uint8_t result = readR8( Operand_t::a ) & readR8( operand1 );
+        writeR8( Operand_t::a, result );
+        setFlagsOf( FlagsOperation_t::AND, result );
+    } else if constexpr( type == ALU_A_XOR_R8 ) {
+        const uint8_t result = readR8( Operand_t::a ) ^ readR8( operand1 );
+        writeR8( Operand_t::a, result );
+        setFlagsOf( FlagsOperation_t::OR, result );
+    } else if constexpr( type == ALU_A_OR_R8 ) {
+        const uint8_t result = readR8( Operand_t::a ) | readR8( operand1 );
+        writeR8( Operand_t::a, result );
+        setFlagsOf( FlagsOperation_t::OR, result );
+    } else if constexpr( type == ALU_CP_A_R8 ) {
+        subFromR8( Operand_t::a, readR8( operand1 ), true );
+    } else if constexpr( type == RLC_R8 ) {
+        const auto result = alu::shift( alu::Shift_t::RLC, readR8( operand1 ), 0 );
+        writeR8( operand1, result.value );
+        setFlags( result.flags );
+    } else if constexpr( type == RRC_R8 ) {
+        const auto result = alu::shift( alu::Shift_t::RRC, readR8( operand1 ), 0 );
+        writeR8( operand1, result.value );
+        setFlags( result.flags );
+    } else if constexpr( type == RL_R8 ) {
+        const auto result = alu::shift( alu::Shift_t::RL, readR8( operand1 ), flags() );
+        writeR8( operand1, result.value );
+        setFlags( result.flags );
+    } else if constexpr( type == RR_R8 ) {
+        const auto result = alu::shift( alu::Shift_t::RR, readR8( operand1 ), flags() );
+        writeR8( operand1, result.value );
+        setFlags( result.flags );
+    } else if constexpr( type == SLA_R8 ) {
+        const auto result = alu::shift( alu::Shift_t::SLA, readR8( operand1 ), 0 );
+        writeR8( operand1, result.value );
+        setFlags( result.flags );
+    } else if constexpr( type == SRA_R8 ) {
+        const auto result = alu::shift( alu::Shift_t::SRA, readR8( operand1 ), 0 );
+        writeR8( operand1, result.value );
+        setFlags( result.flags );
+    } else if constexpr( type == SWAP_R8 ) {
+        const auto result = alu::shift( alu::Shift_t::SWAP, readR8( operand1 ), 0 );
+        writeR8( operand1, result.value );
+        setFlags( result.flags );
+    } else if constexpr( type == SRL_R8 ) {
+        const auto result = alu::shift( alu::Shift_t::SRL, readR8( operand1 ), 0 );
+        writeR8( operand1, result.value );
+        setFlags( result.flags );
+    } else if constexpr( type == BIT_R8 ) {
+        setFlags( alu::bit( std::to_underlying( operand1 ), readR8( operand2 ), flags() ) );
+    } else if constexpr( type == RES_R8 ) {
+        const uint8_t value    = readR8( operand2 );
+        const uint8_t newValue = value & static_cast<uint8_t>( ~( 1 << std::to_underlying( operand1 ) ) );
+        writeR8( operand2, newValue );
+    } else if constexpr( type == SET_R8 ) {
+        const uint8_t value    = readR8( operand2 );
+        const uint8_t newValue = value | static_cast<uint8_t>( 1 << std::to_underlying( operand1 ) );
+        writeR8( operand2, newValue );
+    }
+}
+
+template<Cpu::MicroOperationType_t type, Cpu::Operand_t operand1, Cpu::Operand_t operand2>
+void Cpu::executeSpecialised( Cpu& cpu, [[maybe_unused]] MicroOperation_t mop ) {
+#ifdef DEBUG
+    cpu.logOperation( mop );
+#endif
+    cpu.executeR8<type>( operand1, operand2 );
+}
+
+namespace cpu_handlers {
+// Handlers of type indexed by r8 operand
+template<Cpu::MicroOperationType_t type, std::size_t... r8>
+constexpr std::array<Cpu::MopHandler_t, sizeof...( r8 )> forR8( std::index_sequence<r8...> ) {
+    return { &Cpu::executeSpecialised<type, static_cast<Cpu::Operand_t>( r8 ), Cpu::Operand_t::NONE>... };
+}
+// Handlers of type indexed by 8 * operand1 + operand2, bit index and r8 or two r8 operands
+template<Cpu::MicroOperationType_t type, std::size_t... operands>
+constexpr std::array<Cpu::MopHandler_t, sizeof...( operands )> forPairs( std::index_sequence<operands...> ) {
+    return { &Cpu::executeSpecialised<type, static_cast<Cpu::Operand_t>( operands / 8 ),
+                                      static_cast<Cpu::Operand_t>( operands % 8 )>... };
+}
+template<Cpu::MicroOperationType_t type>
+constexpr auto r8Handlers = forR8<type>( std::make_index_sequence<8> {} );
+template<Cpu::MicroOperationType_t type>
+constexpr auto pairHandlers = forPairs<type>( std::make_index_sequence<64> {} );
+} // namespace cpu_handlers
+
+constexpr Cpu::MopHandler_t Cpu::handlerOf( const MicroOperation_t mop ) {
+    using namespace cpu_handlers;
+    using enum MicroOperationType_t;
+    const auto operand1 = std::to_underlying( mop.operand1 );
+    const auto operand2 = std::to_underlying( mop.operand2 );
+    if( mop.type == LD_R8_TO_R8 || mop.type == BIT_R8 || mop.type == RES_R8 || mop.type == SET_R8 ) {
+        if( operand1 > 7 || operand2 > 7 )
+            return &executeMop;
+    } else if( operand1 > 7 )
+        return &executeMop;
+
+    switch( mop.type ) {
+    case LD_Z_TO_R8:
+        return r8Handlers<LD_Z_TO_R8>[operand1];
+    case INC_R8:
+        return r8Handlers<INC_R8>[operand1];
+    case DEC_R8:
+        return r8Handlers<DEC_R8>[operand1];
+    case LD_R8_TO_R8:
+        return pairHandlers<LD_R8_TO_R8>[8 * operand1 + operand2];
+    case LD_R8_TO_pHL:
+        return r8Handlers<LD_R8_TO_pHL>[operand1];
+    case ALU_ADD_R8_TO_A:
+        return r8Handlers<ALU_ADD_R8_TO_A>[operand1];
+    case ALU_ADC_R8_TO_A:
+        return r8Handlers<ALU_ADC_R8_TO_A>[operand1];
+    case ALU_SUB_R8_FROM_A:
+        return r8Handlers<ALU_SUB_R8_FROM_A>[operand1];
+    case ALU_SBC_R8_FROM_A:
+        return r8Handlers<ALU_SBC_R8_FROM_A>[operand1];
+    case ALU_A_AND_R8:
+        return r8Handlers<ALU_A_AND_R8>[operand1];
+    case ALU_A_XOR_R8:
+        return r8Handlers<ALU_A_XOR_R8>[operand1];
+    case ALU_A_OR_R8:
+        return r8Handlers<ALU_A_OR_R8>[operand1];
+    case ALU_CP_A_R8:
+        return r8Handlers<ALU_CP_A_R8>[operand1];
+    case RLC_R8:
+        return r8Handlers<RLC_R8>[operand1];
+    case RRC_R8:
+        return r8Handlers<RRC_R8>[operand1];
+    case RL_R8:
+        return r8Handlers<RL_R8>[operand1];
+    case RR_R8:
+        return r8Handlers<RR_R8>[operand1];
+    case SLA_R8:
+        return r8Handlers<SLA_R8>[operand1];
+    case SRA_R8:
+        return r8Handlers<SRA_R8>[operand1];
+    case SWAP_R8:
+        return r8Handlers<SWAP_R8>[operand1];
+    case SRL_R8:
+        return r8Handlers<SRL_R8>[operand1];
+    case BIT_R8:
+        return pairHandlers<BIT_R8>[8 * operand1 + operand2];
+    case RES_R8:
+        return pairHandlers<RES_R8>[8 * operand1 + operand2];
+    case SET_R8:
+        return pairHandlers<SET_R8>[8 * operand1 + operand2];
+    default:
+        return &executeMop;
+    }
+}
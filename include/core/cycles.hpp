@@ -1,3 +1,4 @@
+#pragma once
 #include <cstdint>
 namespace cycles {
 // source: https://gbdev.io/gb-opcodes/optables/
@@ -0,0 +1,119 @@
+#pragma once
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <optional>
+
+// Debug policies, the last template parameter of Emulator. Emulator consults its policy only when
+// Tdebug::enabled, so with NoDebugger the checks aren't compiled at all.
+struct NoDebugger {
+    static constexpr bool enabled = false;
+};
+
+// PC breakpoints and read / write watchpoints. Breakpoints are checked when the CPU is about to decode an
+// instruction, CPUs executing several instructions in one tick ( fused sequences, JIT blocks ) are checked
+// at the first one only. A watched access stops emulation after the tick doing it, instruction fetches
+// count as reads. While stopped, Emulator::tick does nothing and returns 0.
+class Debugger {
+public:
+    static constexpr bool enabled = true;
+
+    enum Access_t : uint8_t { READ = 1, WRITE = 2 };
+    enum class Reason_t : uint8_t { PAUSE, BREAKPOINT, READ_WATCHPOINT, WRITE_WATCHPOINT };
+    struct Stop {
+        Reason_t reason;
+        uint16_t address; // PC, or the accessed address of a watchpoint
+        uint8_t value;    // read or written value of a watchpoint
+    };
+
+private:
+    std::bitset<0x10000> breakpoints;
+    std::bitset<0x10000> readWatchpoints;
+    std::bitset<0x10000> writeWatchpoints;
+    // Access_t bits of the watchpoints within each 256 byte page, accesses of other pages return at once
+    std::array<uint8_t, 0x100> watchedPages {};
+    std::optional<Stop> stop;
+    bool anyPoint = false;
+    bool pausing  = false;
+    // Resumed on an instruction boundary, the instruction there is executed without a check
+    bool resumedOnInstruction = false;
+
+    void updatePage( const uint16_t address ) {
+        const unsigned page = address >> 8;
+        uint8_t flags       = 0;
+        for( unsigned i = page << 8; i < ( page + 1 ) << 8; i++ )
+            flags |= static_cast<uint8_t>( readWatchpoints[i] * READ | writeWatchpoints[i] * WRITE );
+        watchedPages[page] = flags;
+    }
+    void updateAnyPoint() {
+        anyPoint = breakpoints.any() || readWatchpoints.any() || writeWatchpoints.any();
+    }
+
+public:
+    void setBreakpoint( const uint16_t address, const bool set = true ) {
+        breakpoints[address] = set;
+        updateAnyPoint();
+    }
+    void setWatchpoint( const uint16_t address, const Access_t access, const bool set = true ) {
+        if( access & READ )
+            readWatchpoints[address] = set;
+        if( access & WRITE )
+            writeWatchpoints[address] = set;
+        updatePage( address );
+        updateAnyPoint();
+    }
+    void clear() {
+        breakpoints.reset();
+        readWatchpoints.reset();
+        writeWatchpoints.reset();
+        watchedPages.fill( 0 );
+        anyPoint = false;
+    }
+    // Emulator then executes instruction by instruction, without skipping idle and bulk loops
+    bool armed() const {
+        return anyPoint || pausing || resumedOnInstruction;
+    }
+
+    bool stopped() const {
+        return stop.has_value();
+    }
+    const std::optional<Stop>& stopReason() const {
+        return stop;
+    }
+    // Stops before the next instruction
+    void pause() {
+        pausing = true;
+    }
+    void resume() {
+        if( stop && ( stop->reason == Reason_t::PAUSE || stop->reason == Reason_t::BREAKPOINT ) )
+            resumedOnInstruction = true;
+        stop.reset();
+    }
+    // Executes one instruction, then stops again
+    void step() {
+        resume();
+        pause();
+    }
+
+    // Called by Emulator before the instruction at pc is decoded, true when it has to stop
+    bool onInstruction( const uint16_t pc ) {
+        if( resumedOnInstruction ) {
+            resumedOnInstruction = false;
+            return false;
+        }
+        if( pausing || breakpoints[pc] ) {
+            stop    = Stop { pausing ? Reason_t::PAUSE : Reason_t::BREAKPOINT, pc, 0 };
+            pausing = false;
+            return true;
+        }
+        return false;
+    }
+    void onAccess( const Access_t access, const uint16_t address, const uint8_t value ) {
+        if( ! ( watchedPages[address >> 8] & access ) ) [[likely]]
+            return;
+        if( access == READ && readWatchpoints[address] && ! stop )
+            stop = Stop { Reason_t::READ_WATCHPOINT, address, value };
+        else if( access == WRITE && writeWatchpoints[address] && ! stop )
+            stop = Stop { Reason_t::WRITE_WATCHPOINT, address, value };
+    }
+};
@@ -1,17 +1,32 @@
 #pragma once
 #include "core/bus.hpp"
+#include "core/bus_heatmap.hpp"
 #include "core/core_constants.hpp"
 #include "core/cpu.hpp"
+#include "core/debugger.hpp"
+#include "core/execution_profile.hpp"
 #include "core/memory.hpp"
+#include "core/pc_sampler.hpp"
 #include "core/timer.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
 #include <memory>
 
-template<typename Tppu, typename Tcpu = Cpu, typename Tmemory = Memory>
-class Emulator final : public IBus {
+// All state of a running machine except the cartridge is one cache line aligned object. Small hot state
+// ( IE and IF copies, locks, timer ) comes first, then Memory starting with the IO registers. Cpu and PPU
+// follow Memory, as their constructors read it through the bus.
+template<typename Tppu, typename Tcpu = Cpu, typename Tmemory = Memory, typename Tdebug = NoDebugger>
+class alignas( constant::cacheLineSize ) Emulator final : public IBus {
     using JoypadHandler_t = void( IBus& );
 
-    bool vramLocked = false;
-    bool oamLocked  = false;
+    bool vramLocked       = false;
+    bool oamLocked        = false;
+    unsigned oamDmaCycles = 0; // T-cycles until OAM DMA ends, the CPU bus sees only the high page till then
 
     bool inVideoRam( const uint16_t index ) const {
         return addr::videoRam <= index and index < addr::externalRam;
@@ -19,8 +34,192 @@ class Emulator final : public IBus {
     bool inObjectAttributeMemory( const uint16_t index ) const {
         return addr::objectAttributeMemory <= index and index < addr::notUsable;
     }
-    bool inTimerRange( const uint16_t index ) const {
-        return addr::timer <= index and index <= addr::timerEnd;
+    bool inIoRegisters( const uint16_t index ) const {
+        return addr::ioRegisters <= index and index < addr::highRam;
+    }
+    bool locked( const uint16_t index ) const {
+        return ( inVideoRam( index ) && vramLocked ) || ( inObjectAttributeMemory( index ) && oamLocked ) ||
+               ( oamDmaCycles && index < addr::ioRegisters );
+    }
+
+    // Writes of IO registers 0xFF00-0xFF7F, one handler per register. Registers without side effects
+    // are stored directly, the others go to the component owning them.
+    using IoWriter_t = void ( Emulator::* )( uint16_t, uint8_t );
+    void writeIoDirect( const uint16_t address, const uint8_t value ) {
+        memory.write( address, value );
+    }
+    void writeTimer( const uint16_t address, const uint8_t value ) {
+        timer.write( address, value );
+    }
+    void writeInterruptFlag( const uint16_t address, const uint8_t value ) {
+        memory.write( address, value );
+        interrupts.update( address, value );
+    }
+    void writeLcdY( const uint16_t, const uint8_t value ) {
+        ppu.writeLcdY( *this, value );
+    }
+    // OAM is filled at once, the CPU can't see it before the transfer ends anyway. IO registers stay
+    // accessible with HRAM, PPU and timer access theirs through the bus too. Code cached by CachedCpu
+    // or JitCpu keeps executing from work RAM meanwhile, only its data accesses see the locked bus.
+    void writeOamDma( const uint16_t address, const uint8_t value ) {
+        memory.write( address, value );
+        // Sources above work RAM read its echo
+        const uint16_t source = static_cast<uint16_t>( ( value > 0xDF ? value - 0x20 : value ) << 8 );
+        if constexpr( requires { memory.oamDma( source ); } )
+            memory.oamDma( source );
+        else
+            for( uint16_t i = 0; i < size::oam; i++ )
+                memory.write( static_cast<uint16_t>( addr::objectAttributeMemory + i ),
+                              memory.read( static_cast<uint16_t>( source + i ) ) );
+#ifdef BUS_PROFILING
+        heatmap.countRead( BusHeatmap::DMA, source, size::oam );
+        heatmap.countWrite( BusHeatmap::DMA, addr::objectAttributeMemory, size::oam );
+#endif
+        oamDmaCycles = constant::oamDmaDuration;
+        if constexpr( requires { memory.setDmaLock( true ); } )
+            memory.setDmaLock( true );
+    }
+    void advanceOamDma( const unsigned tCycles ) {
+        oamDmaCycles -= std::min( oamDmaCycles, tCycles );
+        if constexpr( requires { memory.setDmaLock( false ); } ) {
+            if( ! oamDmaCycles )
+                memory.setDmaLock( false );
+        }
+    }
+    static constexpr std::array<IoWriter_t, 0x80> makeIoWriters() {
+        std::array<IoWriter_t, 0x80> writers;
+        writers.fill( &Emulator::writeIoDirect );
+        for( uint16_t address = addr::timer; address <= addr::timerEnd; address++ )
+            writers[address - addr::ioRegisters] = &Emulator::writeTimer;
+        writers[addr::interruptFlag - addr::ioRegisters] = &Emulator::writeInterruptFlag;
+        writers[addr::lcdY - addr::ioRegisters]          = &Emulator::writeLcdY;
+        writers[addr::oamDma - addr::ioRegisters]        = &Emulator::writeOamDma;
+        return writers;
+    }
+    static constexpr std::array<IoWriter_t, 0x80> ioWriters = makeIoWriters();
+
+#ifdef BUS_PROFILING
+    mutable BusHeatmap heatmap;
+    BusHeatmap::Requester_t requester = BusHeatmap::CPU;
+#endif
+    // Bus accesses are charged to the component ticked last, nothing is counted without BUS_PROFILING
+    void chargeTo( [[maybe_unused]] const BusHeatmap::Requester_t requester_ ) {
+#ifdef BUS_PROFILING
+        requester = requester_;
+#endif
+    }
+    void countRead( [[maybe_unused]] const uint16_t address,
+                    [[maybe_unused]] const std::size_t count = 1 ) const {
+#ifdef BUS_PROFILING
+        heatmap.countRead( requester, address, count );
+#endif
+    }
+    void countWrite( [[maybe_unused]] const uint16_t address, [[maybe_unused]] const std::size_t count = 1 ) {
+#ifdef BUS_PROFILING
+        heatmap.countWrite( requester, address, count );
+#endif
+    }
+
+    uint8_t watchRead( const uint16_t address, const uint8_t value ) const {
+        if constexpr( Tdebug::enabled )
+            debugger.onAccess( Tdebug::READ, address, value );
+        return value;
+    }
+    // Breakpoints and watchpoints need every instruction executed on its own
+    bool debuggerArmed() const {
+        if constexpr( Tdebug::enabled )
+            return debugger.armed();
+        return false;
+    }
+
+    // T-cycles until an enabled interrupt can be requested at the earliest, at most cycleBudget
+    unsigned cyclesUntilInterrupt( const unsigned cycleBudget ) const {
+        const uint8_t enabled = interrupts.enabled();
+        unsigned tCycles      = cycleBudget;
+        if( enabled & bitMask::vBlankInterrupt )
+            tCycles = std::min( tCycles, ppu.cyclesUntilVBlank() );
+        if( enabled & bitMask::timerInterrupt )
+            tCycles = std::min( tCycles, timer.cyclesUntilOverflow() );
+        return tCycles;
+    }
+
+    // T-cycles of the whole idle loop iterations, which pass before the polled register or control flow
+    // can change, 0 when the CPU doesn't spin in an idle loop
+    unsigned idleLoopCycles( const unsigned cycleBudget ) {
+        if constexpr( requires { cpu.idleLoop(); } ) {
+            const auto* loop = cpu.idleLoop();
+            if( ! loop )
+                return 0;
+            unsigned tCycles = cyclesUntilInterrupt( cycleBudget );
+            switch( loop->polledAddress ) {
+            case addr::lcdY:
+                tCycles = std::min( tCycles, ppu.cyclesUntilLineEnd() );
+                break;
+            case addr::lcdStatus:
+                tCycles = std::min( tCycles, ppu.cyclesUntilModeChange() );
+                break;
+            default: // interrupt flag, requests of disabled interrupts count too
+                tCycles = std::min( { tCycles, ppu.cyclesUntilVBlank(), timer.cyclesUntilOverflow() } );
+            }
+            const unsigned iterations = tCycles / loop->iterationCycles;
+            cpu.skipIdleIterations( iterations );
+            return iterations * loop->iterationCycles;
+        }
+        return 0;
+    }
+
+    // T-cycles of the bulk loop iterations done at once, 0 when the CPU doesn't run a bulk loop or they have
+    // to be executed. Bytes are moved straight between Tmemory storage, VRAM only while it stays unlocked.
+    unsigned bulkLoopCycles( const unsigned cycleBudget ) {
+        if constexpr( requires {
+                          cpu.bulkTransfer();
+                          memory.ramSpan( 0 );
+                      } ) {
+            const auto transfer = cpu.bulkTransfer();
+            if( ! transfer )
+                return 0;
+            const auto destination = memory.ramSpan( transfer->destination );
+            std::size_t count      = std::min<std::size_t>(
+                    { transfer->iterations, cycleBudget / transfer->iterationCycles, destination.size() } );
+            const bool readsVideoRam = ! transfer->fill && inVideoRam( transfer->source );
+            if( inVideoRam( transfer->destination ) || readsVideoRam ) {
+                if( vramLocked )
+                    return 0;
+                const unsigned unlockedCycles = ppu.cyclesUntilModeChange();
+                count = std::min<std::size_t>( count, unlockedCycles / transfer->iterationCycles );
+            }
+
+            if( transfer->fill )
+                std::memset( destination.data(), transfer->value, count );
+            else if( transfer->source < addr::videoRam ) { // ROM, banks are mapped by the cartridge
+                count = std::min<std::size_t>( count, 0x4000 - ( transfer->source & 0x3FFF ) );
+                for( std::size_t i = 0; i < count; i++ )
+                    destination[i] = memory.read( static_cast<uint16_t>( transfer->source + i ) );
+            } else {
+                const auto source = memory.ramSpan( transfer->source );
+                if( source.empty() ) // external RAM or unmapped
+                    return 0;
+                count = std::min( count, source.size() );
+                // Overlapping copy would read bytes written by its earlier iterations
+                const std::less<const uint8_t*> before;
+                if( before( source.data(), destination.data() + count ) &&
+                    before( destination.data(), source.data() + count ) )
+                    return 0;
+                std::memcpy( destination.data(), source.data(), count );
+            }
+            if( ! count )
+                return 0;
+            if( ! transfer->fill )
+                countRead( transfer->source, count );
+            countWrite( transfer->destination, count );
+
+            // Before the notifications, which can drop the loop's block
+            cpu.skipBulkIterations( static_cast<unsigned>( count ) );
+            for( std::size_t i = 0; i < count; i++ )
+                cpu.notifyWrite( static_cast<uint16_t>( transfer->destination + i ) );
+            return static_cast<unsigned>( count ) * transfer->iterationCycles;
+        }
+        return 0;
     }
 
 public:
@@ -30,62 +229,163 @@ public:
     Tcpu cpu;
     Tppu ppu;
     JoypadHandler_t& joypadHandler;
+    PcSampler sampler;
+    [[no_unique_address]] mutable Tdebug debugger;
 
     // IBus interface
     uint8_t read( uint16_t address ) const override {
-        if( ( inVideoRam( address ) && vramLocked ) || ( inObjectAttributeMemory( address ) && oamLocked ) ) {
-            [[unlikely]] return 0xFF;
+        countRead( address );
+        // Memory with page tables handles the locks itself
+        if constexpr( requires { memory.busRead( address ); } )
+            return watchRead( address, memory.busRead( address ) );
+        if( locked( address ) ) {
+            [[unlikely]] return watchRead( address, 0xFF );
         }
-        return memory.read( address );
+        return watchRead( address, memory.read( address ) );
     }
     void write( uint16_t address, uint8_t value ) override {
-        if( ( inVideoRam( address ) && vramLocked ) || ( inObjectAttributeMemory( address ) && oamLocked ) ) {
+        countWrite( address );
+        if constexpr( Tdebug::enabled )
+            debugger.onAccess( Tdebug::WRITE, address, value );
+        if( inIoRegisters( address ) ) [[unlikely]]
+            ( this->*ioWriters[address - addr::ioRegisters] )( address, value );
+        else if constexpr( requires { memory.busWrite( address, value ); } )
+            memory.busWrite( address, value );
+        else if( locked( address ) ) {
             [[unlikely]] return;
-        }
-        if( inTimerRange( address ) ) {
-            [[unlikely]] timer.write( address, value );
-            return;
-        }
-        memory.write( address, value );
+        } else
+            memory.write( address, value );
+        if( address == addr::interruptEnableRegister ) [[unlikely]]
+            interrupts.update( address, value );
+        // CPU with a code cache has to see MBC register writes and self-modifying code
+        if constexpr( requires { cpu.notifyWrite( address ); } )
+            cpu.notifyWrite( address );
     }
 
     void setOamLock( bool locked ) override {
         oamLocked = locked;
+        if constexpr( requires { memory.setOamLock( locked ); } )
+            memory.setOamLock( locked );
     }
     void setVramLock( bool locked ) override {
         vramLocked = locked;
+        if constexpr( requires { memory.setVramLock( locked ); } )
+            memory.setVramLock( locked );
     }
 
     SpriteAttribute getSpriteAttribute( uint8_t sprite_index ) const override {
         const uint16_t address = static_cast<uint16_t>( addr::objectAttributeMemory + sprite_index * 4 );
+        countRead( address, 4 );
         return { .y         = memory.read( address ),
                  .x         = memory.read( address + 1 ),
                  .tileIndex = memory.read( address + 2 ),
                  .flags     = memory.read( address + 3 ) };
     }
     uint8_t directMemRead( uint16_t address ) const override {
+        countRead( address );
         return memory.read( address );
     }
     virtual void directMemWrite( uint16_t address, uint8_t value ) override {
+        countWrite( address );
         memory.write( address, value );
+        if( address == addr::interruptFlag || address == addr::interruptEnableRegister ) [[unlikely]]
+            interrupts.update( address, memory.read( address ) );
+    }
+    unsigned mappedRomBank( uint16_t address ) const override {
+        return cartridge->mappedRomBank( address );
+    }
+    // Armed debugger and the bus heatmap have to see instruction fetches, so they disable the fetch window
+    FetchPage fetchPage( [[maybe_unused]] const uint16_t address ) const override {
+#ifndef BUS_PROFILING
+        if constexpr( requires { memory.busReadPages; } ) {
+            if( ! debuggerArmed() ) [[likely]]
+                return { memory.busReadPages[address >> 8], &memory.mapVersion };
+        }
+#endif
+        return {};
+    }
+    unsigned cyclesUntilInterruptRequest() const override {
+        // Only V-Blank and timer requests are predicted
+        if( interrupts.pending() ||
+            ( interrupts.enabled() & ~( bitMask::vBlankInterrupt | bitMask::timerInterrupt ) ) )
+            return 0;
+        return cyclesUntilInterrupt( std::numeric_limits<unsigned>::max() );
     }
 
 
-    unsigned tick() {
-        unsigned ticks = cpu.tick();
+    // Returns T-cycles executed. A halted CPU is skipped straight to the next M-cycle in which an enabled
+    // interrupt can be requested ( timer overflow, V-Blank ), and idle and bulk loops of a CPU detecting them
+    // are skipped by whole iterations, but never past cycleBudget, as joypad input comes from the frontend
+    // between ticks. Returns 0 while the debugger is stopped.
+    unsigned tick( const unsigned cycleBudget = constant::frameDuration ) {
+        if constexpr( Tdebug::enabled ) {
+            if( debugger.stopped() )
+                return 0;
+        }
+        chargeTo( BusHeatmap::CPU );
+        unsigned ticks;
+        if( cpu.waitsForInterrupt() )
+            ticks = std::max( 4u, ( cyclesUntilInterrupt( cycleBudget ) + 3 ) & ~3u );
+        else if( debuggerArmed() ) [[unlikely]] {
+            if constexpr( Tdebug::enabled ) {
+                if( cpu.atInstructionStart() && debugger.onInstruction( cpu.getPC() ) )
+                    return 0;
+            }
+            // Window fetched before the debugger got armed would bypass watchpoints
+            if constexpr( requires { cpu.dropFetchWindow(); } )
+                cpu.dropFetchWindow();
+            ticks = cpu.tick();
+        }
+        else if( oamDmaCycles ) [[unlikely]] // skipped loops would bypass the locked bus
+            ticks = cpu.tick();
+        else if( const unsigned idleCycles = idleLoopCycles( cycleBudget ) )
+            ticks = idleCycles;
+        else if( const unsigned bulkCycles = bulkLoopCycles( cycleBudget ) )
+            ticks = bulkCycles;
+        else
+            ticks = cpu.tick();
+        if( oamDmaCycles ) [[unlikely]]
+            advanceOamDma( ticks );
+        if( sampler.active() ) [[unlikely]] {
+            if( const unsigned samplesDue = sampler.advance( ticks ) )
+                sampler.record( *this, cpu.getPC(), cpu.readR16( Cpu::Operand_t::sp ), samplesDue );
+        }
         // const bool cpuDoubleSpeed = memory.read( addr::key1 ) & ( 1 << 7 );
+        // Ticked with the final Emulator type, so their bus accesses aren't virtual calls
         for( unsigned i = 0; i < ticks; i++ ) {
-            ppu.tick();
-            timer.tick();
+            chargeTo( BusHeatmap::PPU );
+            ppu.template tick<Tppu>( *this );
+            chargeTo( BusHeatmap::TIMER );
+            timer.tick( *this );
         }
         //apu.tick();
-        return 4;
+        return ticks;
+    }
+#ifdef BUS_PROFILING
+    // Bus accesses since construction or the last reset
+    const BusHeatmap& busHeatmap() const {
+        return heatmap;
+    }
+    void resetBusHeatmap() {
+        heatmap.reset();
+    }
+#endif
+#ifdef CPU_PROFILING
+    // Opcodes and micro-operations executed since construction or the last reset
+    const ExecutionProfile& executionProfile() const {
+        return cpu.executionProfile();
+    }
+    void resetExecutionProfile() {
+        cpu.resetExecutionProfile();
     }
+#endif
     Emulator( std::unique_ptr<CoreCartridge>&& cartridge_, JoypadHandler_t& joypadHandler_ )
         : cartridge( std::move( cartridge_ ) )
         , memory( cartridge.get() )
         , cpu( *this )
         , ppu( *this )
         , joypadHandler( joypadHandler_ ) {
+        interrupts.update( addr::interruptEnableRegister, memory.read( addr::interruptEnableRegister ) );
+        interrupts.update( addr::interruptFlag, memory.read( addr::interruptFlag ) );
     }
 };
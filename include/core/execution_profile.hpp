@@ -0,0 +1,48 @@
+#pragma once
+#include "core/cycles.hpp"
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+
+// Executions and T-cycles per opcode and micro-operation type, collected by CPUs in CPU_PROFILING build.
+// Halted cycles, skipped idle and bulk loop iterations and JIT compiled code aren't counted.
+class ExecutionProfile {
+public:
+    struct Counter {
+        uint64_t executions = 0;
+        uint64_t tCycles    = 0;
+    };
+    // Indexed by opcode, or 0x100 | second byte for CB prefixed opcodes
+    std::array<Counter, 512> opcodes {};
+    // Indexed by Cpu::MicroOperationType_t, each takes one M-cycle. Only the micro-operation Cpu counts them.
+    std::array<Counter, 256> microOperations {};
+    // Interrupts dispatched and T-cycles of dispatching them
+    Counter interrupts;
+
+    void countOpcode( const uint16_t opcode, const unsigned tCycles ) {
+        opcodes[opcode].executions++;
+        opcodes[opcode].tCycles += tCycles;
+    }
+    void countMicroOperation( const uint8_t type ) {
+        microOperations[type].executions++;
+        microOperations[type].tCycles += 4;
+    }
+    // Instructions executed at once ( e.g. fused ), all but the last took their unbranched cycles
+    void countSequence( const std::initializer_list<uint16_t> sequence, unsigned tCycles ) {
+        const uint16_t* last = sequence.end() - 1;
+        for( const uint16_t* opcode = sequence.begin(); opcode != last; opcode++ ) {
+            countOpcode( *opcode, cycles::opcodeCycles[*opcode] );
+            tCycles -= cycles::opcodeCycles[*opcode];
+        }
+        countOpcode( *last, tCycles );
+    }
+    void reset() {
+        *this = {};
+    }
+
+    // Executed entries only, columns: kind ( opcode, micro_operation, interrupt ), name, executions, t_cycles
+    std::string toCsv() const;
+    // { "opcodes": [ { "name", "executions", "tCycles" } ], "microOperations": [...], "interrupts": {...} }
+    std::string toJson() const;
+};
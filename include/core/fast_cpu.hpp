@@ -0,0 +1,75 @@
+#pragma once
+#include "core/bus.hpp"
+#include "core/cpu.hpp"
+#include <array>
+#include <cstdint>
+#include <utility>
+
+// Instruction-granular interpreter: every tick() executes one whole instruction ( or interrupt dispatch )
+// and returns its length in T-cycles, so Emulator catches up PPU and timer afterwards.
+// Shares registers and interrupt acknowledgment with Cpu, but bypasses the micro-operation queue.
+class FastCpu : public Cpu {
+protected:
+    bool branchTaken = false;
+    // Instruction bytes following the opcode, set when they were already read ( e.g. by the block cache )
+    const uint8_t* operandBytes = nullptr;
+
+    uint8_t fetch() {
+        if( operandBytes ) {
+            PC++;
+            return *operandBytes++;
+        }
+        return fetchByte( PC++ );
+    }
+    uint16_t fetch16() {
+        const uint8_t low = fetch();
+        return static_cast<uint16_t>( ( fetch() << 8 ) | low );
+    }
+    void push( uint16_t value );
+    uint16_t pop();
+
+    // r8 encoding from opcode, 6 means (HL)
+    uint8_t readOperand( uint8_t code );
+    void writeOperand( uint8_t code, uint8_t value );
+
+    void alu( uint8_t operation, uint8_t value );
+    void aluAdc( uint8_t value );
+    void aluSbc( uint8_t value );
+    uint8_t inc8( uint8_t value );
+    uint8_t dec8( uint8_t value );
+    void addToHL( uint16_t value );
+    uint16_t addSignedToSP();
+    void daa();
+
+    void executeBlock0( uint8_t opcode );
+    void executeBlock3( uint8_t opcode );
+    void executeCB( uint8_t opcode );
+
+    // One handler per opcode, first 256 are indexed by opcode, the next 256 by the second byte of CB opcodes
+    // Each executes the instruction after its opcode was fetched and returns its length in T-cycles
+    using Handler_t = unsigned ( FastCpu::* )();
+    template<uint16_t index>
+    unsigned executeOpcode();
+    template<std::size_t... indices>
+    static constexpr std::array<Handler_t, 512> makeHandlers( std::index_sequence<indices...> );
+    static const std::array<Handler_t, 512> handlers;
+
+    // Returns T-cycles spent halted or dispatching an interrupt, 0 when an instruction should be executed
+    unsigned serviceInterrupts();
+    unsigned executeInstruction();
+    // EI takes effect after the instruction following it
+    void applyDelayedIME( bool wasPending ) {
+        if( wasPending && enableIMELater ) {
+            interruptMasterEnabled = true;
+            enableIMELater         = false;
+        }
+    }
+
+public:
+    FastCpu( IBus& bus_ ) : Cpu( bus_ ) {
+    }
+    unsigned tick();
+    bool atInstructionStart() const {
+        return true;
+    }
+};
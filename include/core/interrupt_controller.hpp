@@ -0,0 +1,40 @@
+#pragma once
+#include "core/core_constants.hpp"
+#include <bit>
+#include <cstdint>
+
+// Copy of IE and IF with their conjunction kept ready. The bus updates it on writes of either register
+// ( by the CPU, timer or PPU ), so checking for a pending interrupt is a single load and test.
+class InterruptController {
+    uint8_t enabled_   = 0;
+    uint8_t requested_ = 0;
+    uint8_t pending_   = 0;
+
+public:
+    uint8_t enabled() const {
+        return enabled_;
+    }
+    uint8_t requested() const {
+        return requested_;
+    }
+    // Requested interrupts which are enabled, regardless of IME
+    uint8_t pending() const {
+        return pending_;
+    }
+    // Value written to addr::interruptEnableRegister or addr::interruptFlag
+    void update( const uint16_t address, const uint8_t value ) {
+        if( address == addr::interruptEnableRegister )
+            enabled_ = value;
+        else
+            requested_ = value;
+        pending_ = enabled_ & requested_ & 0x1F;
+    }
+
+    // Bit number of the highest priority interrupt in a non-zero mask, lower bits take precedence
+    static unsigned highestPriority( const uint8_t interrupts ) {
+        return static_cast<unsigned>( std::countr_zero( interrupts ) );
+    }
+    static uint16_t vectorOf( const unsigned interrupt ) {
+        return static_cast<uint16_t>( 0x40 + 8 * interrupt );
+    }
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include "core/bus.hpp"
+#include "core/cached_cpu.hpp"
+#include <cstddef>
+#include <cstdint>
+
+// CachedCpu which compiles hot blocks to x86-64 machine code ( Linux only, built with ENABLE_JIT ).
+// Compiled code keeps A, F, BC, DE, HL and SP in host registers and runs a whole block per tick(),
+// returning the T-cycles of the executed instructions, so Emulator catches up PPU and timer after the block.
+// It checks no interrupt, blocks which could be interrupted before their end are interpreted instead.
+// PC is a constant within a block and is stored only when the block is left.
+// Memory is accessed through helpers, an access to VRAM, OAM or IO registers leaves the block before
+// the instruction, which is then executed by the interpreter with PPU and timer up to date.
+// Instructions without a translation end the compiled part of a block the same way.
+class JitCpu : public CachedCpu {
+    using Compiled_t = unsigned ( * )( JitCpu* cpu );
+
+    static constexpr std::size_t codeBufferSize = 4 << 20;
+    uint8_t* codeBuffer    = nullptr;
+    std::size_t codeLength = 0;
+
+    // Byte offsets of emulated registers within this object, used by compiled code
+    uint32_t registersOffset;
+    uint32_t spOffset;
+    uint32_t pcOffset;
+
+    // Helpers called from compiled code. Reads return a value above 0xFF ( 0xFFFF ) when the address
+    // has to be accessed by the interpreter, writes return 2 then, 1 if the write changed cached code
+    static uint32_t readHelper( JitCpu* cpu, uint32_t address );
+    static uint32_t read16Helper( JitCpu* cpu, uint32_t address );
+    static uint32_t writeHelper( JitCpu* cpu, uint32_t address, uint32_t value );
+    static uint32_t write16Helper( JitCpu* cpu, uint32_t address, uint32_t value );
+
+    bool compileBlock( Block& block );
+    unsigned runCompiled( const Block& block );
+
+public:
+    // Executions of a block before it gets compiled
+    unsigned hotThreshold = 16;
+    // Instructions of a block compiled at most, the rest is interpreted
+    unsigned maxCompiledLength = maxBlockLength;
+
+    void flushBlocks();
+
+    JitCpu( IBus& bus_ );
+    JitCpu( const JitCpu& )            = delete;
+    JitCpu& operator=( const JitCpu& ) = delete;
+    ~JitCpu();
+    unsigned tick();
+};
@@ -22,6 +22,7 @@ enum CoreError : int {
     StackOverflow                = 420,
     StackUnderflow               = 421,
     CpuTimingImplementationError = 430,
+    JitCompilationError          = 440,
 
     // Cartridge errors (600-799)
     CartridgeNotFound         = 600,
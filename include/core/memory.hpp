@@ -1,17 +1,35 @@
 #pragma once
 #include "core/cartridge.hpp"
 #include "core/core_constants.hpp"
+#include <array>
 #include <cstdint>
+#include <span>
 
+// Accesses go through tables of 256 byte pages. A page of plain storage ( RAM, echo RAM, banks mapped by
+// the cartridge ) resolves with one index and one load, the other pages are null and take the slow path
+// of their handler. Tables of the CPU bus also have locked VRAM and OAM pages null, and during OAM DMA
+// every page below the high page.
 struct Memory {
+    enum class Handler_t : uint8_t { DIRECT, CARTRIDGE, OBJECT_ATTRIBUTE_MEMORY };
+
+    // Hot state first: IO registers ( LCDC, STAT, LY, timer, IF ) and IE, then the tables every access
+    // indexes, bulk RAM last. highPage holds IO registers FF00-FF7F, high RAM and IE, the bus handles
+    // IO side effects.
+    alignas( constant::cacheLineSize ) uint8_t highPage[256] {};
+    std::array<const uint8_t*, 256> busReadPages {};
+    std::array<uint8_t*, 256> busWritePages {};
+    std::array<const uint8_t*, 256> readPages {};
+    std::array<uint8_t*, 256> writePages {};
+    std::array<Handler_t, 256> handlers {}; // slow path of pages null in readPages or writePages
+    unsigned mapVersion = 0;                // incremented whenever a page is mapped
+    bool vramLocked     = false;
+    bool oamLocked      = false;
+    bool dmaLocked      = false;
     CoreCartridge* cartridge; // ROM + optional external RAM
+    alignas( constant::cacheLineSize ) uint8_t oam[256] {}; // FEA0-FEFF isn't usable, it stays zero
     uint8_t videoRam[8192];
     uint8_t workRam00[4096];
     uint8_t workRam0N[4096];
-    uint8_t oam[160];
-    uint8_t ioRegisters[112]; // FF70-FF00, consider not allocating the gaps
-    uint8_t interruptEnableRegister;
-    uint8_t highRam[127];
 
     //helpers
     bool inRom( const uint16_t index ) const {
@@ -51,9 +69,51 @@ struct Memory {
         return addr::highRam <= index and index < addr::interruptEnableRegister;
     }
 
-    uint8_t read( const uint16_t index ) const;
-    void write( const uint16_t index, uint8_t value );
-    void setVramLock( bool locked );
-    void setOamLock( bool locked );
+    bool locked( const uint16_t index ) const {
+        return ( vramLocked && inVideoRam( index ) ) || ( oamLocked && inObjectAttributeMemory( index ) ) ||
+               ( dmaLocked && index < addr::ioRegisters );
+    }
+    void mapPage( unsigned page, const uint8_t* readData, uint8_t* writeData, Handler_t handler );
+    // Maps ROM and external RAM pages to the banks of the cartridge, which calls it when they change
+    void mapCartridge();
+    uint8_t readSlow( uint16_t index ) const;
+    void writeSlow( uint16_t index, uint8_t value );
+
+    // Access ignoring VRAM and OAM locks, as by PPU
+    uint8_t read( const uint16_t index ) const {
+        if( const uint8_t* page = readPages[index >> 8] ) [[likely]]
+            return page[index & 0xFF];
+        return readSlow( index );
+    }
+    void write( const uint16_t index, const uint8_t value ) {
+        if( uint8_t* page = writePages[index >> 8] ) [[likely]]
+            page[index & 0xFF] = value;
+        else
+            writeSlow( index, value );
+    }
+    // Access of the CPU, which reads 0xFF from locked VRAM and OAM and can't write them
+    uint8_t busRead( const uint16_t index ) const {
+        if( const uint8_t* page = busReadPages[index >> 8] ) [[likely]]
+            return page[index & 0xFF];
+        return locked( index ) ? 0xFF : read( index );
+    }
+    void busWrite( const uint16_t index, const uint8_t value ) {
+        if( uint8_t* page = busWritePages[index >> 8] ) [[likely]]
+            page[index & 0xFF] = value;
+        else if( ! locked( index ) )
+            write( index, value );
+    }
+    // Storage of plain RAM ( video, work and high RAM ) from index to the end of its region, empty elsewhere
+    std::span<uint8_t> ramSpan( const uint16_t index );
+    void setVramLock( bool locked_ );
+    void setOamLock( bool locked_ );
+    // Copies the 160 bytes at source to OAM at once
+    void oamDma( uint16_t source );
+    // Hides everything below the high page from the bus while OAM DMA runs
+    void setDmaLock( bool locked_ );
     Memory( CoreCartridge* cartridge_ );
+    // Pages point into the object itself and the cartridge calls back into it
+    Memory( const Memory& )            = delete;
+    Memory& operator=( const Memory& ) = delete;
+    ~Memory();
 };
@@ -0,0 +1,88 @@
+#pragma once
+#include "core/bus.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Sampling profiler of guest code. Every period T-cycles Emulator records the ( ROM bank, PC ) of the CPU,
+// with callers found on the guest stack, into a ring buffer of fixed capacity. Off until start() is called,
+// then one sample costs a few bus reads.
+class PcSampler {
+public:
+    // Bank is the mapped ROM bank for 0x4000-0x7FFF and 0 for any other address
+    struct Location {
+        uint16_t bank;
+        uint16_t address;
+        bool operator==( const Location& ) const = default;
+    };
+    static constexpr std::size_t maxFrames = 8;
+    struct Sample {
+        std::array<Location, maxFrames> frames; // executed location first, then callers
+        uint8_t depth;
+    };
+
+private:
+    std::vector<Sample> buffer;
+    std::size_t next     = 0; // index written by the next sample
+    uint64_t taken       = 0;
+    unsigned period      = 0;
+    unsigned untilSample = 0;
+
+public:
+    // Samples every period T-cycles, keeping the last capacity of them. Clears samples taken before.
+    void start( unsigned period_, std::size_t capacity );
+    void stop() {
+        period = 0;
+    }
+    bool active() const {
+        return period != 0;
+    }
+    // Counts elapsed T-cycles, returns the number of samples due. Skipped HALT or idle loop cycles
+    // span many periods, the remainder counts towards the next sample.
+    unsigned advance( const unsigned tCycles ) {
+        if( untilSample > tCycles ) {
+            untilSample -= tCycles;
+            return 0;
+        }
+        const unsigned overshoot = tCycles - untilSample;
+        untilSample              = period - overshoot % period;
+        return 1 + overshoot / period;
+    }
+    // Stores count equal samples. Return addresses are words on the stack preceded by CALL or RST,
+    // interrupt frames aren't seen.
+    void record( const IBus& bus, uint16_t pc, uint16_t sp, unsigned count = 1 );
+
+    // Kept samples, oldest first
+    std::vector<Sample> samples() const;
+    // Samples overwritten since start()
+    uint64_t droppedSamples() const {
+        return taken - std::min<uint64_t>( taken, buffer.size() );
+    }
+};
+
+// Symbols of an RGBDS or BGB .sym file, which has "bank:address name" lines and ';' comments.
+// Local labels ( containing '.' ) are skipped, so their samples count to the enclosing function.
+class SymbolTable {
+    struct Symbol {
+        PcSampler::Location location;
+        std::string name;
+    };
+    std::vector<Symbol> symbols; // ordered by bank, then address
+
+public:
+    explicit SymbolTable( std::string_view symFile );
+    // Name of the symbol at or before location in the same bank, "bank:address" without one
+    std::string nameOf( PcSampler::Location location ) const;
+    std::size_t size() const {
+        return symbols.size();
+    }
+};
+
+// Lines "self% self total name", ordered by samples in the function itself
+std::string flatProfile( const std::vector<PcSampler::Sample>& samples, const SymbolTable& symbols );
+// Lines "outermost;...;innermost count", the input format of flamegraph.pl and compatible tools
+std::string collapsedStacks( const std::vector<PcSampler::Sample>& samples, const SymbolTable& symbols );
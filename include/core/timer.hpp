@@ -1,5 +1,6 @@
 #pragma once
 #include "core/bus.hpp"
+#include "core/core_constants.hpp"
 #include <cstdint>
 
 // Basic implementation - TODO edge cases
@@ -11,8 +12,57 @@ class Timer {
     bool previousAndResult = false;
 
 public:
-    void tick();
+    // Tbus is the concrete bus type when Emulator ticks, so the accesses aren't virtual calls
+    template<typename Tbus>
+    void tick( Tbus& bus );
+    void tick() {
+        tick( bus );
+    }
     void write( uint16_t address, uint8_t value );
+    // T-cycles until TIMA overflows and requests the timer interrupt, UINT_MAX when TIMA is stopped
+    unsigned cyclesUntilOverflow() const;
     Timer( IBus& bus_ ) : bus( bus_ ) {
     }
 };
+
+template<typename Tbus>
+void Timer::tick( Tbus& bus ) {
+    masterCounter++;
+    // Not through bus.write(), which resets the divider
+    bus.directMemWrite( addr::divider, static_cast<uint8_t>( masterCounter >> 8 ) );
+    const auto timerControl = bus.read( addr::timerControl );
+    const bool timaEnabled  = timerControl & ( 1 << 2 );
+    unsigned mask           = 0;
+    const auto clockSelect  = static_cast<ClockSelect>( timerControl & 0x3 );
+    if( timaEnabled ) {
+        switch( clockSelect ) {
+            using enum ClockSelect;
+        case every16Tcycles:
+            mask = 1 << 3;
+            break;
+        case every64Tcycles:
+            mask = 1 << 5;
+            break;
+        case every256Tcycles:
+            mask = 1 << 7;
+            break;
+        case every1024Tcycles:
+            mask = 1 << 9;
+            break;
+        }
+    }
+
+    bool newAndResult = masterCounter & mask;
+    // increment on falling edge
+    if( previousAndResult && ! newAndResult ) {
+        uint8_t tima = bus.read( addr::timerCounter );
+
+        if( tima == 0xFF ) {
+            bus.write( addr::timerCounter, bus.read( addr::timerModulo ) );
+            bus.write( addr::interruptFlag, bus.read( addr::interruptFlag ) | bitMask::timerInterrupt );
+        } else {
+            bus.write( addr::timerCounter, tima + 1 );
+        }
+    }
+    previousAndResult = newAndResult;
+}
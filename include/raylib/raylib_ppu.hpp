@@ -3,6 +3,8 @@
 #include <raylib.h>
 
 class RaylibPpu final : public CorePpu {
+    friend class CorePpu; // ticks call drawPixel directly
+
 private:
     Color* screenBuffer;
     void drawPixel( uint8_t colorId ) override;
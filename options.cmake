@@ -1,5 +1,10 @@
 # Bolleans
 option(BUILD_TESTS "Build the test suite" ON)
+option(ENABLE_JIT "Build JitCpu, the x86-64 dynamic recompiler (Linux only)" OFF)
+option(ENABLE_LAZY_FLAGS "Compute CPU flags of ALU operations only when they are read" ON)
+option(ENABLE_COMPUTED_GOTO "Dispatch CPU micro-operations through computed goto (GCC, Clang)" ON)
+option(ENABLE_PROFILING "Count executed opcodes and micro-operations with their cycles" OFF)
+option(ENABLE_BUS_PROFILING "Count bus reads and writes per 256 byte page and requester" OFF)
 
 # --------------------------------------------------
 # Standard options
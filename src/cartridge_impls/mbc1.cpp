@@ -29,6 +29,7 @@ MBC1Cartridge::MBC1Cartridge( std::vector<uint8_t>&& rom_ ) : CoreCartridge( std
         logInfo( "MBC1M cartridge detected." );
         isMBCM = true;
     }
+    updateBanks();
 }
 
 unsigned MBC1Cartridge::getRomBankIndex( bool isPrimaryRom ) const {
@@ -79,11 +80,27 @@ unsigned MBC1Cartridge::getRomBankIndex( bool isPrimaryRom ) const {
     return bankIndex;
 }
 
+void MBC1Cartridge::updateBanks() {
+    romBankIndices[0] = getRomBankIndex( true );
+    romBankIndices[1] = getRomBankIndex( false );
+    // Simple banking mode and 8 KiB RAM use the first RAM bank
+    ramBankIndex = ( getRamSize() != RamSize::_8KiB && isInBankingMode ) ? bankingRegister : 0;
+    mapBanks( romBankData( romBankIndices[0] ), romBankData( romBankIndices[1] ),
+              ramEnabled ? ramBankData( ramBankIndex ) : nullptr );
+}
+
 uint8_t MBC1Cartridge::readRom( const uint16_t address, bool isPrimaryRom ) const {
-    uint16_t bankOffset = address % romBankSize;
-    auto romBankIndex   = getRomBankIndex( isPrimaryRom );
+    uint16_t bankOffset    = address % romBankSize;
+    const uint8_t* romBank = mappedBank( isPrimaryRom ? Region_t::ROM_00 : Region_t::ROM_0N );
+    // Only logged
+    [[maybe_unused]] const auto romBankIndex = romBankIndices[isPrimaryRom ? 0 : 1];
+    if( ! romBank ) {
+        logWarning( 0, std::format( "ROM bank {} doesn't exist. Returning {}", romBankIndex,
+                                    toHex( invalidReadValue ) ) );
+        return invalidReadValue;
+    }
 
-    auto returnValue = romBanks[romBankIndex][bankOffset];
+    auto returnValue = romBank[bankOffset];
     logInfo( std::format( "Read value {} from ROM bank {} at offset {}", toHex( returnValue ), romBankIndex,
                           toHex( bankOffset ) ) );
     return returnValue;
@@ -106,22 +123,15 @@ uint8_t MBC1Cartridge::read( const uint16_t address ) {
             return invalidReadValue;
         }
 
-        if( ! ramEnabled ) {
+        const uint8_t* ramBank = mappedBank( Region_t::EXTERNAL_RAM );
+        if( ! ramBank ) {
             logWarning( 0, std::format( "RAM is not enabled. Returning {}", toHex( invalidReadValue ) ) );
             return invalidReadValue;
         }
 
-        if( getRamSize() == RamSize::_8KiB ) {
-            auto returnValue = ramBanks[0][address - ramStartAddress];
-            logInfo( std::format( "Read value {} from RAM bank 0 at address {}", toHex( returnValue ),
-                                  toHex( address ) ) );
-            return returnValue;
-        }
-
-        // TODO: check if secondaryRegister is less or equal to ramBankCount?
-        auto returnValue = ramBanks[bankingRegister][address - ramStartAddress];
+        auto returnValue = ramBank[address - ramStartAddress];
         logInfo( std::format( "Read value {} from RAM bank {} at address {}", toHex( returnValue ),
-                              bankingRegister, toHex( address ) ) );
+                              ramBankIndex, toHex( address ) ) );
         return returnValue;
     }
 
@@ -133,32 +143,30 @@ void MBC1Cartridge::write( const uint16_t address, const uint8_t value ) {
     logDebug( std::format( "Trying to write value {} to address {}", toHex( value ), toHex( address ) ) );
 
     if( isInRamEnableRange( address ) ) {
-        if( value == ramEnableValue ) {
-            ramEnabled = true;
-            logInfo( "RAM enabled" );
-            return;
-        }
-
-        ramEnabled = false;
-        logInfo( "RAM disabled" );
+        ramEnabled = value == ramEnableValue;
+        logInfo( ramEnabled ? "RAM enabled" : "RAM disabled" );
+        updateBanks();
         return;
     }
 
     if( isInRomBankSelectRange( address ) ) {
         selectedRomBankRegister = value & 0b11111; // 5 bits for ROM bank selection
         logInfo( std::format( "ROM bank selection register set to {:#07b}", selectedRomBankRegister ) );
+        updateBanks();
         return;
     }
 
     if( isInSecondaryRegisterRange( address ) ) {
         bankingRegister = value & 0b11; // 2 bits for secondary register
         logInfo( std::format( "Secondary register set to {:#04b}", bankingRegister ) );
+        updateBanks();
         return;
     }
 
     if( isInBankingModeSelectRange( address ) ) {
         isInBankingMode = ( value & 0b1 ) == 1;
         logInfo( std::format( "Banking mode set to {}", isInBankingMode ? "Advanced" : "Simple" ) );
+        updateBanks();
         return;
     }
 
@@ -168,22 +176,14 @@ void MBC1Cartridge::write( const uint16_t address, const uint8_t value ) {
             return;
         }
 
-        if( ! ramEnabled ) {
+        uint8_t* ramBank = mappedBank( Region_t::EXTERNAL_RAM );
+        if( ! ramBank ) {
             logWarning( 0, "RAM is not enabled. Write operation ignored." );
             return;
         }
 
-        if( getRamSize() == RamSize::_8KiB ) {
-            ramBanks[0][address - ramStartAddress] = value;
-            logInfo( std::format( "Wrote value {} to RAM bank 0 at address {}", toHex( value ),
-                                  toHex( address ) ) );
-            return;
-        }
-
-        // TODO: check if secondaryRegister is less or equal to ramBankCount?
-        unsigned ramBankIndex                             = isInBankingMode ? bankingRegister : 0;
-        ramBanks[ramBankIndex][address - ramStartAddress] = value;
-        logInfo( std::format( "Wrote value {} to RAM bank {} at address {}", toHex( value ), bankingRegister,
+        ramBank[address - ramStartAddress] = value;
+        logInfo( std::format( "Wrote value {} to RAM bank {} at address {}", toHex( value ), ramBankIndex,
                               toHex( address ) ) );
         return;
     }
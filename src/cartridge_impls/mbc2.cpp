@@ -18,14 +18,15 @@ MBC2Cartridge::MBC2Cartridge( std::vector<uint8_t>&& rom_ ) : CoreCartridge( std
     }
 
     logDebug( std::format( "Initialize RAM consisting of {} half-bytes", halfByteRamSize ) );
-    ramBanks = std::vector<std::vector<uint8_t>>( 1, std::vector<uint8_t>( halfByteRamSize, 0 ) );
+    allocateRam( 1, halfByteRamSize );
+    updateBanks();
 };
 
 uint8_t MBC2Cartridge::read( const uint16_t address ) {
     logDebug( std::format( "Trying to read at address {}", toHex( address ) ) );
 
     if( isInPrimaryRomRange( address ) ) {
-        const auto returnValue = romBanks[0][address];
+        const auto returnValue = mappedBank( Region_t::ROM_00 )[address];
         logInfo( std::format( "Read value {} from ROM bank 0 at address {}", toHex( returnValue ),
                               toHex( address ) ) );
         return returnValue;
@@ -33,7 +34,13 @@ uint8_t MBC2Cartridge::read( const uint16_t address ) {
 
     if( isInSecondaryRomRange( address ) ) {
         const uint16_t offset  = address % romBankSize;
-        const auto returnValue = romBanks[selectedRomBankRegister][offset];
+        const uint8_t* romBank = mappedBank( Region_t::ROM_0N );
+        if( ! romBank ) {
+            logWarning( 0, std::format( "ROM bank {} doesn't exist. Returning {}", selectedRomBankRegister,
+                                        toHex( invalidReadValue ) ) );
+            return invalidReadValue;
+        }
+        const auto returnValue = romBank[offset];
         logInfo( std::format( "Read value {} from ROM bank {} at offset {}", toHex( returnValue ),
                               selectedRomBankRegister, toHex( offset ) ) );
         return returnValue;
@@ -67,6 +74,7 @@ void MBC2Cartridge::write( const uint16_t address, const uint8_t value ) {
             }
 
             logInfo( std::format( "Selected ROM bank register set to {:#06b}", selectedRomBankRegister ) );
+            updateBanks();
             return;
         }
 
@@ -22,13 +22,20 @@ MBC3Cartridge::MBC3Cartridge( std::vector<uint8_t>&& rom_, bool hasTimer )
         logError( 0, "RAM size greater than 32 KiB is not supported by MBC3 cartridge." );
         return;
     }
+    updateBanks();
 }
 
 uint8_t MBC3Cartridge::readRom( const uint16_t address, bool isPrimaryRom ) const {
-    const auto romBankIndex = isPrimaryRom ? 0u : romSelectRegister;
-    const auto bankOffset   = static_cast<uint16_t>(
+    [[maybe_unused]] const auto romBankIndex = isPrimaryRom ? 0u : romSelectRegister;
+    const auto bankOffset                    = static_cast<uint16_t>(
             address - ( isPrimaryRom ? romStartAddress : ( romStartAddress + romBankSize ) ) );
-    const auto returnValue = romBanks[romBankIndex][bankOffset];
+    const uint8_t* romBank = mappedBank( isPrimaryRom ? Region_t::ROM_00 : Region_t::ROM_0N );
+    if( ! romBank ) {
+        logWarning( 0, std::format( "ROM bank {} doesn't exist. Returning {}", romBankIndex,
+                                    toHex( invalidReadValue ) ) );
+        return invalidReadValue;
+    }
+    const auto returnValue = romBank[bankOffset];
 
     logInfo( std::format( "Read value {} from ROM bank {} at offset {}", toHex( returnValue ), romBankIndex,
                           toHex( bankOffset ) ) );
@@ -102,6 +109,7 @@ void MBC3Cartridge::write( const uint16_t address, const uint8_t value ) {
     if( isInRamOrRtcEnableRange( address ) ) {
         ramAndRtcEnabled = value == ramEnableValue;
         logInfo( std::format( "RAM/RTC access {}abled.", ramAndRtcEnabled ? "en" : "dis" ) );
+        updateBanks();
         return;
     }
 
@@ -116,6 +124,7 @@ void MBC3Cartridge::write( const uint16_t address, const uint8_t value ) {
         romSelectRegister =
                 value == 0 ? 1 : value; // ROM bank 0 is not allowed, so we set it to 1 if 0 is written
         logInfo( std::format( "Selected ROM bank set to: {}", toHex( romSelectRegister ) ) );
+        updateBanks();
         return;
     }
 
@@ -127,6 +136,7 @@ void MBC3Cartridge::write( const uint16_t address, const uint8_t value ) {
         }
         ramBankOrRtcSelectRegister = value;
         logInfo( std::format( "Selected RAM/RTC register set to: {}", toHex( ramBankOrRtcSelectRegister ) ) );
+        updateBanks();
         return;
     }
 
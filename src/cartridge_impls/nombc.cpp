@@ -3,7 +3,10 @@
 #include <format>
 #include <utility>
 
-NoMBCCartridge::NoMBCCartridge( std::vector<uint8_t>&& rom_ ) : CoreCartridge( std::move( rom_ ) ) {};
+NoMBCCartridge::NoMBCCartridge( std::vector<uint8_t>&& rom_ ) : CoreCartridge( std::move( rom_ ) ) {
+    // Banks never change
+    mapBanks( romBankData( 0 ), romBankData( 1 ), ramBankData( 0 ) );
+};
 
 uint8_t NoMBCCartridge::read( const uint16_t address ) {
     logDebug( std::format( "Trying to read at address {}", toHex( address ) ) );
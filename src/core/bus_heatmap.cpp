@@ -0,0 +1,23 @@
+#include "core/bus_heatmap.hpp"
+#include "core/logging.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <string>
+
+#ifdef BUS_PROFILING
+std::string BusHeatmap::toCsv() const {
+    constexpr const char* requesterNames[REQUESTER_COUNT] = { "cpu", "ppu", "dma", "timer" };
+    std::string csv = "page";
+    for( const char* name: requesterNames )
+        csv += std::format( ",{}_reads,{}_writes", name, name );
+    csv += '\n';
+    for( std::size_t page = 0; page < 256; page++ ) {
+        csv += toHex( static_cast<uint8_t>( page ) );
+        for( const auto& requester: pages )
+            csv += std::format( ",{},{}", requester[page].reads, requester[page].writes );
+        csv += '\n';
+    }
+    return csv;
+}
+#endif
@@ -0,0 +1,489 @@
+#include "core/cached_cpu.hpp"
+#include "core/core_constants.hpp"
+#include "core/logging.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <initializer_list>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace {
+// Control flow, HALT and STOP end a block
+constexpr bool endsBlock( const uint8_t opcode ) {
+    switch( opcode ) {
+    case 0x10:
+    case 0x18:
+    case 0x20:
+    case 0x28:
+    case 0x30:
+    case 0x38:
+    case 0x76:
+    case 0xC3:
+    case 0xC9:
+    case 0xD9:
+    case 0xE9:
+        return true;
+    default:
+        // RET cond, JP cond, CALL cond, CALL, RST
+        return opcode >= 0xC0 && ( ( opcode & 0xE7 ) == 0xC0 || ( opcode & 0xE7 ) == 0xC2 ||
+                                   ( opcode & 0xE7 ) == 0xC4 || opcode == 0xCD || ( opcode & 0xC7 ) == 0xC7 );
+    }
+}
+
+// End of the cacheable region containing address, 0 if code there isn't cached
+// VRAM and OAM can get locked and external RAM is banked, so they always go through FastCpu
+constexpr uint32_t cacheableRegionEnd( const uint16_t address ) {
+    if( address < addr::videoRam )
+        return ( address & 0xC000u ) + 0x4000u; // one ROM bank
+    if( addr::workRam00 <= address && address < addr::echoRam00 )
+        return addr::echoRam00;
+    if( addr::highRam <= address && address < addr::interruptEnableRegister )
+        return addr::interruptEnableRegister;
+    return 0;
+}
+
+// Opcodes of instructions from start on are the given ones
+bool matchesOpcodes( const std::vector<CachedCpu::CachedInstruction>& instructions, const std::size_t start,
+                     const std::initializer_list<uint16_t> opcodes ) {
+    if( start + opcodes.size() > instructions.size() )
+        return false;
+    std::size_t i = start;
+    for( const uint16_t opcode: opcodes )
+        if( instructions[i++].opcode != opcode )
+            return false;
+    return true;
+}
+} // namespace
+
+//--------------------------------------------------
+void CachedCpu::translateBlock( uint16_t address, Block& block ) {
+    const uint32_t regionEnd = cacheableRegionEnd( address );
+    uint32_t pc              = address;
+    auto& instructions       = block.instructions;
+    while( instructions.size() < maxBlockLength ) {
+        CachedInstruction instruction { .handler      = nullptr,
+                                        .address      = static_cast<uint16_t>( pc ),
+                                        .opcode       = 0,
+                                        .opcodeLength = 1,
+                                        .operands     = {} };
+        const uint8_t opcode = bus.read( instruction.address );
+        uint8_t operandCount = operandLength( opcode );
+        instruction.opcode   = opcode;
+        if( opcode == 0xCB ) {
+            instruction.opcodeLength = 2;
+            operandCount             = 0;
+        }
+        // Instruction must not reach into memory which is mapped independently
+        if( pc + instruction.opcodeLength + operandCount > regionEnd )
+            break;
+        if( opcode == 0xCB )
+            instruction.opcode = static_cast<uint16_t>( 0x100 | bus.read( static_cast<uint16_t>( pc + 1 ) ) );
+        for( uint8_t i = 0; i < operandCount; i++ )
+            instruction.operands[i] = bus.read( static_cast<uint16_t>( pc + instruction.opcodeLength + i ) );
+        instruction.handler = handlers[instruction.opcode];
+        instructions.push_back( instruction );
+
+        pc += instruction.opcodeLength + operandCount;
+        if( endsBlock( opcode ) )
+            break;
+    }
+
+    if( address >= 0x8000 && ! instructions.empty() ) {
+        const unsigned firstChunk = ( address - 0x8000u ) / chunkSize;
+        const unsigned lastChunk  = ( pc - 1 - 0x8000u ) / chunkSize;
+        // Key stays listed in the other chunks when a block is dropped through one of them
+        for( unsigned chunk = firstChunk; chunk <= lastChunk; chunk++ )
+            if( std::ranges::find( chunkBlocks[chunk], blockKey( address ) ) == chunkBlocks[chunk].end() )
+                chunkBlocks[chunk].push_back( blockKey( address ) );
+    }
+    detectIdleLoop( address, block );
+    detectBulkLoop( address, block );
+    detectFusions( block );
+    logDebug( std::format( "Translated block at {} with {} instructions", toHex( address ),
+                           instructions.size() ) );
+}
+
+// Idle loop loads a polled register to A, computes flags from A alone and branches back to the load while
+// the value doesn't change. Its iterations don't depend on the state before them, any number of them
+// with the same polled value ends in the same state as a single one.
+void CachedCpu::detectIdleLoop( const uint16_t address, Block& block ) {
+    const auto& instructions = block.instructions;
+    if( instructions.size() < 2 )
+        return;
+
+    const CachedInstruction& load = instructions.front();
+    uint16_t polledAddress;
+    if( load.opcode == 0xF0 ) // LDH A, (imm8)
+        polledAddress = static_cast<uint16_t>( 0xFF00 | load.operands[0] );
+    else if( load.opcode == 0xFA ) // LD A, (imm16)
+        polledAddress = static_cast<uint16_t>( load.operands[0] | load.operands[1] << 8 );
+    else
+        return;
+    if( polledAddress != addr::lcdY && polledAddress != addr::lcdStatus &&
+        polledAddress != addr::interruptFlag )
+        return;
+
+    const CachedInstruction& branch = instructions.back();
+    uint16_t target;
+    switch( branch.opcode ) {
+    case 0x20:
+    case 0x28:
+    case 0x30:
+    case 0x38: // JR cond, imm8
+        target = static_cast<uint16_t>( branch.address + 2 + static_cast<int8_t>( branch.operands[0] ) );
+        break;
+    case 0xC2:
+    case 0xCA:
+    case 0xD2:
+    case 0xDA: // JP cond, imm16
+        target = static_cast<uint16_t>( branch.operands[0] | branch.operands[1] << 8 );
+        break;
+    default:
+        return;
+    }
+    if( target != address )
+        return;
+
+    unsigned iterationCycles = cycles::opcodeCycles[load.opcode] + cycles::opcodeCyclesBranched[branch.opcode];
+    for( std::size_t i = 1; i + 1 < instructions.size(); i++ ) {
+        const uint16_t opcode = instructions[i].opcode;
+        switch( opcode ) {
+        case 0x00: // NOP
+        case 0xA7: // AND A
+        case 0xB7: // OR A
+        case 0xE6: // AND imm8
+        case 0xFE: // CP imm8
+            iterationCycles += cycles::opcodeCycles[opcode];
+            break;
+        default:
+            if( ( opcode & 0x1C7 ) != 0x147 ) // BIT n, A
+                return;
+            iterationCycles += cycles::opcodeCyclesCb[opcode & 0xFF];
+        }
+    }
+    block.polledAddress   = polledAddress;
+    block.iterationCycles = iterationCycles;
+    logDebug( std::format( "Block at {} is an idle loop polling {}", toHex( address ),
+                           toHex( polledAddress ) ) );
+}
+
+void CachedCpu::detectFusions( Block& block ) {
+    auto& instructions = block.instructions;
+    for( std::size_t i = 0; i < instructions.size(); i++ ) {
+        using enum Fusion_t;
+        if( matchesOpcodes( instructions, i, { 0x2A, 0x12 } ) )
+            instructions[i].fusion = COPY_HL_TO_DE;
+        else if( matchesOpcodes( instructions, i, { 0x0B, 0x78, 0xB1, 0x20 } ) )
+            instructions[i].fusion = DEC_BC_LOOP;
+        else if( matchesOpcodes( instructions, i, { 0xF0, 0xFE } ) )
+            instructions[i].fusion = LDH_CP;
+    }
+}
+
+// Bulk loop is the whole block, its JR NZ branches back to the start while the counter isn't zero
+void CachedCpu::detectBulkLoop( const uint16_t address, Block& block ) {
+    const auto& instructions = block.instructions;
+    if( instructions.empty() )
+        return;
+    const CachedInstruction& branch = instructions.back();
+    if( branch.opcode != 0x20 ||
+        static_cast<uint16_t>( branch.address + 2 + static_cast<int8_t>( branch.operands[0] ) ) != address )
+        return;
+
+    using enum BulkLoop_t;
+    const bool copies              = matchesOpcodes( instructions, 0, { 0x2A, 0x12, 0x13 } );
+    const std::size_t counterStart = copies ? 3 : 1;
+    if( ! copies && ! matchesOpcodes( instructions, 0, { 0x22 } ) )
+        return;
+    if( copies && instructions.size() == 7 && matchesOpcodes( instructions, 3, { 0x0B, 0x78, 0xB1 } ) )
+        block.bulkLoop = COPY_BC;
+    else if( instructions.size() == counterStart + 2 && ( instructions[counterStart].opcode == 0x05 ||
+                                                          instructions[counterStart].opcode == 0x0D ) ) {
+        block.bulkLoop    = copies ? COPY_R8 : FILL_R8;
+        block.bulkCounter = instructions[counterStart].opcode == 0x05 ? Operand_t::b : Operand_t::c;
+    } else
+        return;
+
+    block.iterationCycles = cycles::opcodeCyclesBranched[branch.opcode];
+    for( std::size_t i = 0; i + 1 < instructions.size(); i++ )
+        block.iterationCycles += cycles::opcodeCycles[instructions[i].opcode];
+    logDebug( std::format( "Block at {} is a bulk loop", toHex( address ) ) );
+}
+
+CachedCpu::Block* CachedCpu::findBlock( uint16_t address ) {
+    if( ! cacheableRegionEnd( address ) )
+        return nullptr;
+
+    const auto [it, inserted] = blocks.try_emplace( blockKey( address ) );
+    if( inserted )
+        translateBlock( address, it->second );
+    if( it->second.instructions.empty() ) { // instruction crosses region end, left for FastCpu
+        blocks.erase( it );
+        return nullptr;
+    }
+    return &it->second;
+}
+
+void CachedCpu::refreshRomBanks() {
+    romBanks[0] = bus.mappedRomBank( addr::rom00 );
+    romBanks[1] = bus.mappedRomBank( addr::rom0N );
+}
+
+void CachedCpu::notifyWrite( uint16_t address ) {
+    if( address < addr::videoRam ) { // MBC register, cached blocks of other banks stay valid
+        refreshRomBanks();
+        cursor = blockEnd = nullptr;
+        spinningBlock     = nullptr;
+        invalidations++;
+        return;
+    }
+    // IO registers and IE never hold cached code, IE shares its chunk with high RAM
+    if( address >= addr::ioRegisters &&
+        ( address < addr::highRam || address == addr::interruptEnableRegister ) )
+        return;
+    if( addr::echoRam00 <= address && address < addr::objectAttributeMemory )
+        address -= addr::echoRam00 - addr::workRam00;
+
+    auto& chunk = chunkBlocks[( address - 0x8000u ) / chunkSize];
+    if( chunk.empty() ) [[likely]]
+        return;
+    for( const auto key: chunk )
+        blocks.erase( key );
+    chunk.clear();
+    cursor = blockEnd = nullptr; // executed block might be gone
+    spinningBlock     = nullptr;
+    invalidations++;
+}
+
+void CachedCpu::flushBlocks() {
+    blocks.clear();
+    for( auto& chunk: chunkBlocks )
+        chunk.clear();
+    refreshRomBanks();
+    cursor = blockEnd = nullptr;
+    spinningBlock     = nullptr;
+    invalidations++;
+}
+
+CachedCpu::CachedCpu( IBus& bus_ ) : FastCpu( bus_ ) {
+    refreshRomBanks();
+}
+
+//--------------------------------------------------
+CachedCpu::Block* CachedCpu::enterBlock( uint16_t address ) {
+    Block* block = findBlock( address );
+    if( ! block ) {
+        cursor = blockEnd = nullptr;
+        spinningBlock     = nullptr;
+        return nullptr;
+    }
+    cursor   = block->instructions.data();
+    blockEnd = cursor + block->instructions.size();
+
+    if( block->polledAddress ) [[unlikely]] {
+        spinningBlock = block;
+        spinningValue = bus.read( block->polledAddress );
+    } else if( block->bulkLoop != BulkLoop_t::NONE ) [[unlikely]]
+        spinningBlock = block;
+    else
+        spinningBlock = nullptr;
+    return block;
+}
+
+const CachedCpu::Block* CachedCpu::idleLoop() const {
+    // Whole block executed and branched back, without any other block in between
+    if( ! idleLoopSkipping || ! spinningBlock || ! spinningBlock->polledAddress || cursor != blockEnd ||
+        PC != spinningBlock->instructions.front().address )
+        return nullptr;
+    // Pending interrupt is dispatched before the next iteration
+    if( interruptMasterEnabled && pendingInterrupts() )
+        return nullptr;
+    if( bus.read( spinningBlock->polledAddress ) != spinningValue )
+        return nullptr;
+    return spinningBlock;
+}
+
+void CachedCpu::skipIdleIterations( const unsigned count ) {
+    skippedIdleIterations += count;
+    skippedIdleCycles += static_cast<uint64_t>( count ) * spinningBlock->iterationCycles;
+}
+
+std::optional<CachedCpu::BulkTransfer> CachedCpu::bulkTransfer() const {
+    // Whole block executed and branched back, like in idleLoop()
+    if( ! bulkTransfers || ! spinningBlock || spinningBlock->bulkLoop == BulkLoop_t::NONE ||
+        cursor != blockEnd || PC != spinningBlock->instructions.front().address )
+        return std::nullopt;
+    const Block& loop = *spinningBlock;
+    const bool fill   = loop.bulkLoop == BulkLoop_t::FILL_R8;
+
+    // Iterations left until the counter reaches zero, the last one doesn't branch back
+    unsigned remaining;
+    if( loop.bulkLoop == BulkLoop_t::COPY_BC )
+        remaining = readPair( std::to_underlying( Operand_t::bc ) );
+    else
+        remaining = registers[r8Index[std::to_underlying( loop.bulkCounter )]];
+    if( ! remaining )
+        remaining = loop.bulkLoop == BulkLoop_t::COPY_BC ? 0x10000 : 0x100;
+    unsigned iterations = remaining - 1;
+    // JR leaves the delayed EI applied, IME is final here
+    if( interruptMasterEnabled ) {
+        const unsigned window = bus.cyclesUntilInterruptRequest();
+        iterations            = std::min( iterations, window ? ( window - 1 ) / loop.iterationCycles : 0 );
+    }
+    if( ! iterations )
+        return std::nullopt;
+
+    const uint16_t source      = readPair( std::to_underlying( Operand_t::hl ) );
+    const uint16_t destination = fill ? source : readPair( std::to_underlying( Operand_t::de ) );
+    // Writes to the chunks of the loop's own code, also through echo RAM, drop its block,
+    // the iterations reaching them are executed one by one
+    uint32_t target = destination;
+    if( addr::echoRam00 <= target && target < addr::objectAttributeMemory )
+        target -= addr::echoRam00 - addr::workRam00;
+    const uint32_t codeStart = loop.instructions.front().address & ~( chunkSize - 1u );
+    const uint32_t codeEnd   = ( loop.instructions.back().address + 1u ) / chunkSize * chunkSize + chunkSize;
+    if( codeStart <= target && target < codeEnd )
+        return std::nullopt;
+    if( target < codeStart )
+        iterations = static_cast<unsigned>( std::min<uint32_t>( iterations, codeStart - target ) );
+    return BulkTransfer { .source          = source,
+                          .destination     = destination,
+                          .fill            = fill,
+                          .value           = registers[aIndex],
+                          .iterations      = iterations,
+                          .iterationCycles = loop.iterationCycles };
+}
+
+void CachedCpu::skipBulkIterations( const unsigned count ) {
+    using enum Operand_t;
+    const Block& loop     = *spinningBlock;
+    const uint16_t source = readR16( hl );
+    writeR16( hl, static_cast<uint16_t>( source + count ) );
+    if( loop.bulkLoop != BulkLoop_t::FILL_R8 ) {
+        writeR16( de, static_cast<uint16_t>( readR16( de ) + count ) );
+        writeR8( a, bus.read( static_cast<uint16_t>( source + count - 1 ) ) ); // last copied byte
+    }
+    if( loop.bulkLoop == BulkLoop_t::COPY_BC ) {
+        const uint16_t counter = static_cast<uint16_t>( readR16( bc ) - count );
+        const uint8_t result   = static_cast<uint8_t>( msb( counter ) | lsb( counter ) );
+        writeR16( bc, counter );
+        writeR8( a, result );
+        setFlagsOf( FlagsOperation_t::OR, result );
+    } else // flags of the last DEC
+        writeR8( loop.bulkCounter, dec8( static_cast<uint8_t>( readR8( loop.bulkCounter ) - count + 1 ) ) );
+    bulkTransferredBytes += count;
+}
+
+bool CachedCpu::interruptFreeFor( const unsigned tCycles ) const {
+    if( ! interruptMasterEnabled && ! enableIMELater )
+        return true;
+    return bus.cyclesUntilInterruptRequest() > tCycles;
+}
+
+unsigned CachedCpu::executeFused() {
+    using enum Operand_t;
+    const CachedInstruction* first = cursor;
+    const Fusion_t type            = first->fusion; // block can be gone after the last write
+    const bool enableIMEAfterThis  = enableIMELater;
+    unsigned tCycles;
+    switch( type ) {
+    case Fusion_t::COPY_HL_TO_DE: {
+        const uint16_t destination = readR16( de );
+        // Write happens in the last M-cycle, it has to be to memory without timed side effects
+        const bool untimed =
+                ( addr::externalRam <= destination && destination < addr::objectAttributeMemory ) ||
+                ( addr::highRam <= destination && destination < addr::interruptEnableRegister );
+        if( ! untimed || ! interruptFreeFor( cycles::opcodeCycles[0x2A] ) )
+            return 0;
+        const uint16_t source = readR16( hl );
+        const uint8_t value   = bus.read( source );
+        writeR16( hl, static_cast<uint16_t>( source + 1 ) );
+        writeR8( a, value );
+        PC      = static_cast<uint16_t>( PC + 2 );
+        cursor  = first + 2;
+        tCycles = cycles::opcodeCycles[0x2A] + cycles::opcodeCycles[0x12];
+        bus.write( destination, value ); // last, it can invalidate the block
+    } break;
+    case Fusion_t::DEC_BC_LOOP: {
+        if( ! interruptFreeFor( cycles::opcodeCycles[0x0B] + cycles::opcodeCycles[0x78] +
+                                cycles::opcodeCycles[0xB1] ) )
+            return 0;
+        const uint16_t counter = static_cast<uint16_t>( readR16( bc ) - 1 );
+        const uint8_t result   = static_cast<uint8_t>( msb( counter ) | lsb( counter ) );
+        writeR16( bc, counter );
+        writeR8( a, result );
+        setFlagsOf( FlagsOperation_t::OR, result );
+
+        const CachedInstruction& jump = first[3];
+        // Past JR NZ, which branches back while BC isn't 0
+        PC      = static_cast<uint16_t>( jump.address + 2 );
+        tCycles = cycles::opcodeCycles[0x0B] + cycles::opcodeCycles[0x78] + cycles::opcodeCycles[0xB1];
+        if( result ) {
+            PC = static_cast<uint16_t>( PC + static_cast<int8_t>( jump.operands[0] ) );
+            tCycles += cycles::opcodeCyclesBranched[0x20];
+        } else
+            tCycles += cycles::opcodeCycles[0x20];
+        cursor = first + 4;
+    } break;
+    case Fusion_t::LDH_CP: {
+        if( ! interruptFreeFor( cycles::opcodeCycles[0xF0] ) )
+            return 0;
+        // Only the IO read, in the same M-cycle as unfused
+        writeR8( a, bus.read( static_cast<uint16_t>( 0xFF00 | first->operands[0] ) ) );
+        subFromR8( a, first[1].operands[0], true );
+        PC      = static_cast<uint16_t>( PC + 4 );
+        cursor  = first + 2;
+        tCycles = cycles::opcodeCycles[0xF0] + cycles::opcodeCycles[0xFE];
+    } break;
+    default:
+        return 0;
+    }
+    applyDelayedIME( enableIMEAfterThis );
+    fusedSequences++;
+#ifdef CPU_PROFILING
+    switch( type ) {
+    case Fusion_t::COPY_HL_TO_DE:
+        profile.countSequence( { 0x2A, 0x12 }, tCycles );
+        break;
+    case Fusion_t::DEC_BC_LOOP:
+        profile.countSequence( { 0x0B, 0x78, 0xB1, 0x20 }, tCycles );
+        break;
+    default:
+        profile.countSequence( { 0xF0, 0xFE }, tCycles );
+    }
+#endif
+    return tCycles;
+}
+
+unsigned CachedCpu::executeCachedInstruction() {
+    if( cursor->fusion != Fusion_t::NONE && fusion ) {
+        if( const unsigned tCycles = executeFused() )
+            return tCycles;
+    }
+    // Copy, executed instruction can invalidate its own block
+    const CachedInstruction instruction = *cursor++;
+    const bool enableIMEAfterThis       = enableIMELater;
+    PC += instruction.opcodeLength;
+    operandBytes           = instruction.operands;
+    const unsigned tCycles = ( this->*instruction.handler )();
+    operandBytes           = nullptr;
+    applyDelayedIME( enableIMEAfterThis );
+#ifdef CPU_PROFILING
+    profile.countOpcode( instruction.opcode, tCycles );
+#endif
+    return tCycles;
+}
+
+unsigned CachedCpu::tick() {
+    if( const unsigned tCycles = serviceInterrupts() )
+        return tCycles;
+
+    if( cursor == blockEnd || cursor->address != PC ) [[unlikely]] {
+        if( ! enterBlock( PC ) )
+            return executeInstruction();
+    }
+    return executeCachedInstruction();
+}
@@ -2,6 +2,7 @@
 
 #include "core/core_constants.hpp"
 #include "core/logging.hpp"
+#include <array>
 #include <format>
 #include <type_traits>
 #include <utility>
@@ -143,11 +144,18 @@ void CoreCartridge::initRam( const CoreCartridge::RamSizeByte size ) {
     }
     setRamSize( size );
 
-    ramBanks = std::vector<std::vector<uint8_t>>( getRamBankCount(), std::vector<uint8_t>( ramBankSize, 0 ) );
+    allocateRam( getRamBankCount(), ramBankSize );
     logInfo( std::format( "Initialized {} RAM banks of size {} bytes", ramBanks.size(),
                           toHex( ramBankSize ) ) );
 }
 
+void CoreCartridge::allocateRam( const std::size_t bankCount, const std::size_t bankSize ) {
+    ram.assign( bankCount * bankSize, 0 );
+    ramBanks.clear();
+    for( std::size_t bank = 0; bank < bankCount; bank++ )
+        ramBanks.emplace_back( ram.data() + bank * bankSize, bankSize );
+}
+
 CoreCartridge::CoreCartridge( std::vector<uint8_t>&& rom_ ) : rom( std::move( rom_ ) ) {
     logDebug( "CoreCartridge constructor" );
     logDebug( std::format( "Read cartridgeType byte: {}", toHex( rom[addr::cartridgeType] ) ) );
@@ -183,3 +191,12 @@ bool CoreCartridge::checkCopyRightHeader( const uint16_t bankNumber ) const {
 
     return isLogoEqual;
 }
+
+void CoreCartridge::mapBanks( uint8_t* rom00, uint8_t* rom0N, uint8_t* externalRam ) {
+    const std::array<uint8_t*, 3> banks { rom00, rom0N, externalRam };
+    if( banks == mappedBanks )
+        return;
+    mappedBanks = banks;
+    if( bankListener )
+        bankListener();
+}
@@ -3,83 +3,17 @@
 #include "core/logging.hpp"
 #include <cstdint>
 #include <format>
-#include <limits>
+#include <iterator>
+#include <string_view>
 #include <utility>
 
 // Decoding and execution have separate files
 
 uint8_t Cpu::addU8ToU8( uint8_t value, uint8_t value2 ) {
-    bool cFlag         = value + value2 > std::numeric_limits<uint8_t>::max();
-    bool halfCarryFlag = ( ( value & 0xF ) + ( value2 & 0xF ) ) > 0xF;
-
-    const uint8_t result = value + value2;
-    setZNHCFlags( ! result, false, halfCarryFlag, cFlag );
-    return result;
-};
-
-void Cpu::addToR8( Operand_t operand, uint8_t value ) {
-    auto currentValue  = readR8( operand );
-    bool cFlag         = currentValue + value > std::numeric_limits<uint8_t>::max();
-    bool halfCarryFlag = ( ( currentValue & 0xF ) + ( value & 0xF ) ) > 0xF;
-
-    currentValue += value;
-    writeR8( operand, currentValue );
-    setZNHCFlags( ! currentValue, false, halfCarryFlag, cFlag );
-};
-
-void Cpu::subFromR8( Operand_t operand, uint8_t value, bool discard ) {
-    auto currentValue = readR8( operand );
-    bool cFlag        = value > currentValue;
-    //due to integer promotion substraction operands are promoted to ints
-    bool halfCarryFlag = ( ( currentValue & 0xF ) - ( value & 0xF ) ) < 0;
-
-    const uint8_t newValue = currentValue - value;
-    if( ! discard )
-        writeR8( operand, newValue );
-    setZNHCFlags( ! newValue, true, halfCarryFlag, cFlag );
+    setFlagsOf( FlagsOperation_t::ADD, value, value2 );
+    return static_cast<uint8_t>( value + value2 );
 };
 
-uint8_t Cpu::readR8( Operand_t opd ) {
-    if( opd == Operand_t::a ) {
-        const int aIndex = 6;
-        return registers[aIndex];
-    }
-    if( opd == Operand_t::f ) {
-        const int fIndex = 7;
-        return registers[fIndex];
-    }
-    return registers[std::to_underlying( opd )];
-}
-
-void Cpu::writeR8( Operand_t opd, uint8_t value ) {
-    if( opd == Operand_t::a ) {
-        constexpr int aIndex = 6;
-        registers[aIndex]    = value;
-    } else if( opd == Operand_t::f ) {
-        constexpr int fIndex = 7;
-        registers[fIndex]    = value;
-    } else
-        registers[std::to_underlying( opd )] = value;
-}
-
-uint16_t Cpu::readR16( Operand_t opd ) {
-    if( opd == Operand_t::sp )
-        return SP;
-    else
-        return static_cast<uint16_t>( registers[std::to_underlying( opd ) * 2] << 8 |
-                                      ( registers[std::to_underlying( opd ) * 2 + 1] ) );
-}
-
-void Cpu::writeR16( Operand_t opd, uint16_t value ) {
-    if( opd == Operand_t::sp )
-        SP = value;
-    else {
-        registers[std::to_underlying( opd ) * 2]     = msb( value );
-        registers[std::to_underlying( opd ) * 2 + 1] = lsb( value );
-    }
-}
-
-
 bool Cpu::isConditionMet( Operand_t condition ) const {
     bool conditionMet = false;
     using enum Operand_t;
@@ -97,8 +31,23 @@ bool Cpu::isConditionMet( Operand_t condition ) const {
 }
 
 //--------------------------------------------------
+namespace {
+using enum Cpu::MicroOperationType_t;
+// Sequences which don't come from the decoded opcode table
+constexpr Cpu::MicroOperation_t nopMopQueue[]       = { NOP, END };
+constexpr Cpu::MicroOperation_t interruptMopQueue[] = { NOP, SP_DEC, LD_PCH_TO_SP, LD_PCL_TO_SP__LD_WZ_TO_PC, NOP,
+                                                        END };
+} // namespace
+
+const Cpu::MicroOperation_t Cpu::emptyMopQueue[1] = { MicroOperationType_t::END };
+
 unsigned Cpu::tick() {
     MicroOperationType_t currentMopType = mopQueue[atMicroOperationNr].type;
+    if( currentMopType == MicroOperationType_t::END && halted ) {
+        if( ! pendingInterrupts() )
+            return 4;
+        halted = false; // woken up even with IME off
+    }
     if( currentMopType == MicroOperationType_t::END && ! handleInterrupts() ) {
         logDebug( std::format( "PC: {} - Decoding next instruction", toHex( PC ) ) );
         mopQueue           = decode();
@@ -106,68 +55,79 @@ unsigned Cpu::tick() {
         currentMopType     = mopQueue[0].type;
     }
 
-    execute( mopQueue[atMicroOperationNr] );
-    if( ! lastConditionCheck && ( currentMopType == MicroOperationType_t::CHECK_COND ||
-                                  currentMopType == MicroOperationType_t::COND_CHECK__LD_IMM_TO_W ||
-                                  currentMopType == MicroOperationType_t::COND_CHECK__LD_IMM_TO_Z ) ) {
-        mopQueue[atMicroOperationNr + 1] = { MicroOperationType_t::NOP };
-        mopQueue[atMicroOperationNr + 2] = { MicroOperationType_t::END };
-    }
+    const MicroOperation_t& mop = mopQueue[atMicroOperationNr];
+#ifdef CPU_PROFILING
+    profile.countMicroOperation( std::to_underlying( mop.type ) );
+    if( profiledOpcode != noProfiledOpcode )
+        profile.opcodes[profiledOpcode].tCycles += 4;
+#endif
+    mop.handler( *this, mop );
     if( enableIMELater && atMicroOperationNr == 0 ) { // DI takes one cycle, so we are just after next one
         interruptMasterEnabled = true;
         enableIMELater         = false;
     }
-    atMicroOperationNr++;
+    if( ! lastConditionCheck && ( currentMopType == MicroOperationType_t::CHECK_COND ||
+                                  currentMopType == MicroOperationType_t::COND_CHECK__LD_IMM_TO_W ||
+                                  currentMopType == MicroOperationType_t::COND_CHECK__LD_IMM_TO_Z ) ) {
+        // Decoded table holds the longer version ( branch taken ), shorten it to one idle cycle
+        mopQueue           = nopMopQueue;
+        atMicroOperationNr = 0;
+    } else
+        atMicroOperationNr++;
     return 4; // One M-cycle
 }
 
 bool Cpu::handleInterrupts() {
-    if( ! interruptMasterEnabled )
+    if( ! acceptInterrupt() )
         return false;
-    const auto interruptEnable = bus.read( addr::interruptEnableRegister );
-    const auto interruptFlag   = bus.read( addr::interruptFlag );
-    bool executeInterrupt      = false;
-    if( interruptEnable & 0x1 && interruptFlag & 0x1 ) { //VBlank
-        setWZ( 0x40 );
-        bus.write( addr::interruptFlag, interruptFlag & ~0x1 );
-        executeInterrupt = true;
-    } else if( interruptEnable & ( 1 << 1 ) && interruptFlag & ( 1 << 1 ) ) { //LCD
-        setWZ( 0x48 );
-        bus.write( addr::interruptFlag, interruptFlag & ~( 1 << 1 ) );
-        executeInterrupt = true;
-    } else if( interruptEnable & ( 1 << 2 ) && interruptFlag & ( 1 << 2 ) ) { //Timer
-        setWZ( 0x50 );
-        bus.write( addr::interruptFlag, interruptFlag & ~( 1 << 2 ) );
-        executeInterrupt = true;
-    } else if( interruptEnable & ( 1 << 3 ) && interruptFlag & ( 1 << 3 ) ) { //Serial
-        setWZ( 0x58 );
-        bus.write( addr::interruptFlag, interruptFlag & ~( 1 << 3 ) );
-        executeInterrupt = true;
-    } else if( interruptEnable & ( 1 << 4 ) && interruptFlag & ( 1 << 4 ) ) { //Joypad
-        setWZ( 0x60 );
-        bus.write( addr::interruptFlag, interruptFlag & ~( 1 << 4 ) );
-        executeInterrupt = true;
-    }
+    mopQueue           = interruptMopQueue;
+    atMicroOperationNr = 0;
+#ifdef CPU_PROFILING
+    profiledOpcode = noProfiledOpcode;
+#endif
+    return true;
+}
 
-    if( executeInterrupt ) {
-        using enum MicroOperationType_t;
-        mopQueue               = { { NOP, SP_DEC, LD_PCH_TO_SP, LD_PCL_TO_SP__LD_WZ_TO_PC, NOP } };
-        atMicroOperationNr     = 0;
-        interruptMasterEnabled = false;
-        return true;
-    }
-    return false;
+bool Cpu::acceptInterrupt() {
+    if( ! interruptMasterEnabled )
+        return false;
+    const uint8_t pending = bus.interrupts.pending();
+    if( ! pending )
+        return false;
+    const unsigned interrupt = InterruptController::highestPriority( pending );
+    setWZ( InterruptController::vectorOf( interrupt ) );
+    bus.write( addr::interruptFlag, static_cast<uint8_t>( bus.interrupts.requested() & ~( 1 << interrupt ) ) );
+    interruptMasterEnabled = false;
+#ifdef CPU_PROFILING
+    profile.interrupts.executions++;
+    profile.interrupts.tCycles += 20;
+#endif
+    return true;
 };
 
+uint8_t Cpu::fetchSlow( const uint16_t address ) {
+    // Without page tables the window only spares asking again until PC leaves the page
+    static constexpr unsigned unmapped = 0;
+    auto page = bus.fetchPage( address );
+    if( ! page.version )
+        page = { nullptr, &unmapped };
+    fetchWindow = { page.data, page.version, *page.version, static_cast<unsigned>( address >> 8 ) };
+    return page.data ? page.data[address & 0xFF] : bus.read( address );
+}
 
-Cpu::Cpu( IBus& bus_ ) : bus( bus_ ) {
+Cpu::Cpu( IBus& bus_ ) : mopQueue( nopMopQueue ), bus( bus_ ) {
+    // DMG values
+    writePair( std::to_underlying( Operand_t::bc ), 0x0013 );
+    writePair( std::to_underlying( Operand_t::de ), 0x00D8 );
+    writePair( std::to_underlying( Operand_t::hl ), 0x014D );
+    writePair( std::to_underlying( Operand_t::af ), 0x0100 );
     //set register f
     const bool headerChecksumNonZero = bus.read( addr::headerChecksum );
     setZNHCFlags( 1, 0, headerChecksumNonZero, headerChecksumNonZero );
 };
 
 
-#ifdef DEBUG
+#if defined( DEBUG ) || defined( CPU_PROFILING )
 constexpr std::string_view MicroOperationTypeString[] = {
         "NOP",
         "STOP",
@@ -275,6 +235,11 @@ constexpr std::string_view MicroOperationTypeString[] = {
         "INVALID",
         "END",
 };
+static_assert( std::size( MicroOperationTypeString ) == Cpu::Enum_t( Cpu::MicroOperationType_t::END ) + 1 );
+
+std::string_view Cpu::microOperationName( const MicroOperationType_t type ) {
+    return MicroOperationTypeString[Enum_t( type )];
+}
 #endif
 
 
@@ -285,6 +250,6 @@ void Cpu::logOperation( [[maybe_unused]] MicroOperation_t mop ) {
     // FIXME it's temporary solution
     logDebug( std::format( "MOT<{}>, opd1<{}>, opd2<{}>", MicroOperationTypeString[Enum_t( mop.type )],
                            Enum_t( mop.operand1 ), Enum_t( mop.operand2 ) ) );
-    logDebug( std::format( "CPU flags ZNHC<{:04b}>", ( registers[7] >> 4 ) ) );
+    logDebug( std::format( "CPU flags ZNHC<{:04b}>", ( flags() >> 4 ) ) );
 #endif
 }
@@ -1,11 +1,12 @@
 #include "core/cpu.hpp"
+#include "core/cpu_operand_handlers.hpp"
+#include <array>
 #include <utility>
 
 using enum Cpu::MicroOperationType_t;
 // Operand order is target first, source next
-Cpu::MicroOperations_t Cpu::decode() {
+constexpr Cpu::MicroOperations_t Cpu::decodeOpcode( const uint8_t opcode ) {
     // first check instructions without different operand variants
-    const auto opcode = bus.read( PC++ );
     switch( opcode ) {
     //block 0
     case 0x0:
@@ -69,7 +70,7 @@ Cpu::MicroOperations_t Cpu::decode() {
                    NOP } }; // CALL IMM16
     //the rest
     case 0xCB:
-        return decodeCB();
+        return { { INVALID } }; // prefix is resolved in decode(), CB opcodes have their own table part
     case 0xE2:
         return { { LD_A_TO_FF00_PLUS_C, NOP } }; //LDH pC, A
     case 0xE0:
@@ -117,7 +118,7 @@ Cpu::MicroOperations_t Cpu::decode() {
 }
 
 
-Cpu::MicroOperations_t Cpu::decodeBlock0( const uint8_t opcode ) {
+constexpr Cpu::MicroOperations_t Cpu::decodeBlock0( const uint8_t opcode ) {
     //count from 0
     const auto r8  = static_cast<Operand_t>( 0x7 & ( opcode >> 3 ) );
     const auto r16 = static_cast<Operand_t>( 0x3 & ( opcode >> 4 ) );
@@ -162,7 +163,7 @@ Cpu::MicroOperations_t Cpu::decodeBlock0( const uint8_t opcode ) {
 }
 
 
-Cpu::MicroOperations_t Cpu::decodeBlock2( const uint8_t opcode ) {
+constexpr Cpu::MicroOperations_t Cpu::decodeBlock2( const uint8_t opcode ) {
     const auto r8 = static_cast<Operand_t>( 0x7 & opcode );
     switch( 0x7 & ( opcode >> 3 ) ) {
     case 0x0:
@@ -210,7 +211,7 @@ Cpu::MicroOperations_t Cpu::decodeBlock2( const uint8_t opcode ) {
 }
 
 
-Cpu::MicroOperations_t Cpu::decodeBlock3( const uint8_t opcode ) {
+constexpr Cpu::MicroOperations_t Cpu::decodeBlock3( const uint8_t opcode ) {
     const auto condition = static_cast<Operand_t>( 0x3 & ( opcode >> 3 ) );
     const auto r16stk    = static_cast<Operand_t>( 0x3 & ( opcode >> 4 ) );
     switch( 0x7 & opcode ) {
@@ -245,8 +246,7 @@ Cpu::MicroOperations_t Cpu::decodeBlock3( const uint8_t opcode ) {
 }
 
 
-Cpu::MicroOperations_t Cpu::decodeCB() {
-    const auto opcodeSecondByte = bus.read( PC );
+constexpr Cpu::MicroOperations_t Cpu::decodeCB( const uint8_t opcodeSecondByte ) {
     const auto r8               = static_cast<Operand_t>( opcodeSecondByte & 0x7 );
     const auto b3index          = static_cast<Operand_t>( 0x7 & ( opcodeSecondByte >> 3 ) );
     switch( 0x3 & ( opcodeSecondByte >> 6 ) ) {
@@ -315,3 +315,31 @@ Cpu::MicroOperations_t Cpu::decodeCB() {
         std::unreachable();
     }
 }
+
+
+namespace {
+// First 256 entries are indexed by opcode, the next 256 by the second byte of CB-prefixed opcodes.
+// Micro-operations with r8 operands get handlers specialised for them.
+constexpr std::array<Cpu::MicroOperations_t, 512> decodedOpcodes = [] {
+    std::array<Cpu::MicroOperations_t, 512> table {};
+    for( unsigned i = 0; i < 256; i++ ) {
+        table[i]       = Cpu::decodeOpcode( static_cast<uint8_t>( i ) );
+        table[256 + i] = Cpu::decodeCB( static_cast<uint8_t>( i ) );
+    }
+    for( auto& mops: table )
+        for( auto& mop: mops )
+            mop.handler = Cpu::handlerOf( mop );
+    return table;
+}();
+} // namespace
+
+const Cpu::MicroOperation_t* Cpu::decode() {
+    const auto opcode = fetchByte( PC++ );
+    // FETCH_SECOND_BYTE increments PC
+    const unsigned index = opcode == 0xCB ? 256 + fetchByte( PC ) : opcode;
+#ifdef CPU_PROFILING
+    profiledOpcode = static_cast<uint16_t>( index );
+    profile.countOpcode( profiledOpcode, 0 ); // M-cycles are added by tick()
+#endif
+    return decodedOpcodes[index].data();
+}
@@ -1,245 +1,263 @@
+#include "core/alu_tables.hpp"
 #include "core/core_utils.hpp"
 #include "core/cpu.hpp"
+#include "core/cpu_operand_handlers.hpp"
 #include "core/logging.hpp"
+#include <iterator>
 #include <utility>
 
+// With COMPUTED_GOTO ( GCC and Clang ) a micro-operation jumps straight to its handler through a table of
+// label addresses indexed by MicroOperationType_t. Otherwise, e.g. on MSVC, the same handlers are cases
+// of a switch. Each handler returns when done.
+#ifdef COMPUTED_GOTO
+#define MOP_CASE( type ) mop_##type
+#define MOP_DEFAULT      mop_default
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#else
+#define MOP_CASE( type ) case type
+#define MOP_DEFAULT      default
+#endif
+
 void Cpu::execute( MicroOperation_t mop ) {
     logOperation( mop );
+#ifdef COMPUTED_GOTO
+    // In the order of MicroOperationType_t enumerators, those without a handler go to the default one
+    static const void* const dispatchTable[] = {
+            &&mop_NOP, &&mop_STOP, &&mop_LD_IMM_TO_Z, &&mop_LD_IMM_TO_W, &&mop_LD_SPL_TO_pWZ,
+            &&mop_LD_SPH_TO_pWZ, &&mop_RLCA, &&mop_RRCA, &&mop_RLA, &&mop_RRA, &&mop_DAA, &&mop_CPL,
+            &&mop_SCF, &&mop_CCF, &&mop_ALU_CALC_RELATIVE_JUMP, &&mop_IDU_LD_WZ_PLUS_1_TO_PC, &&mop_HALT,
+            &&mop_ALU_ADD_Z_TO_A, &&mop_ALU_ADC_Z_TO_A, &&mop_ALU_SUB_Z_FROM_A, &&mop_default,
+            &&mop_ALU_A_AND_Z, &&mop_ALU_A_XOR_Z, &&mop_ALU_A_OR_Z, &&mop_ALU_A_CP_Z, &&mop_ALU_ADD_SPL_TO_Z,
+            &&mop_default, &&mop_ALU_SPH_ADC_ADJ_TO_W, &&mop_LD_WZ_TO_SP, &&mop_POP_SP_TO_Z,
+            &&mop_POP_SP_TO_W, &&mop_LD_WZ_TO_PC, &&mop_LD_WZ_TO_PC__ENABLE_IME, &&mop_JP_TO_HL, &&mop_SP_DEC,
+            &&mop_LD_PCH_TO_SP, &&mop_LD_PCL_TO_SP__LD_WZ_TO_PC, &&mop_LD_A_TO_FF00_PLUS_C,
+            &&mop_LD_A_TO_FF00_PLUS_Z, &&mop_LD_A_TO_pWZ, &&mop_LD_FF00_PLUS_C_TO_Z, &&mop_LD_Z_TO_R8,
+            &&mop_LD_FF00_PLUS_Z_TO_Z, &&mop_LD_pWZ_TO_Z, &&mop_ALU_SPL_PLUS_Z_TO_L,
+            &&mop_ALU_SPH_ADC_ADJ_TO_H, &&mop_LD_HL_TO_SP, &&mop_DI, &&mop_EI, &&mop_COND_CHECK__LD_IMM_TO_Z,
+            &&mop_INC_R8, &&mop_LD_pHL_TO_Z, &&mop_ALU_LD_Z_PLUS_1_TO_pHL, &&mop_ALU_LD_Z_MINUS_1_TO_pHL,
+            &&mop_DEC_R8, &&mop_LD_Z_TO_pHL, &&mop_LD_WZ_TO_R16, &&mop_LD_A_TO_R16_MEM, &&mop_IDU_INC_R16,
+            &&mop_ALU_ADD_LSB_R16_TO_L, &&mop_ALU_ADC_MSB_R16_TO_H, &&mop_LD_R16_MEM_TO_Z, &&mop_IDU_DEC_R16,
+            &&mop_LD_R8_TO_R8, &&mop_LD_R8_TO_pHL, &&mop_ALU_ADD_R8_TO_A, &&mop_ALU_ADC_R8_TO_A,
+            &&mop_ALU_SUB_R8_FROM_A, &&mop_ALU_SBC_Z_FROM_A, &&mop_ALU_SBC_R8_FROM_A, &&mop_ALU_A_AND_R8,
+            &&mop_ALU_A_XOR_R8, &&mop_ALU_A_OR_R8, &&mop_ALU_CP_A_R8, &&mop_CHECK_COND,
+            &&mop_COND_CHECK__LD_IMM_TO_W, &&mop_LD_PCL_TO_SP__LD_TGT3_TO_PC, &&mop_LD_WZ_TO_R16STK,
+            &&mop_PUSH_MSB_R16STK_TO_SP, &&mop_PUSH_LSB_R16STK_TO_SP, &&mop_FETCH_SECOND_BYTE,
+            &&mop_LD_RLC_Z_TO_pHL, &&mop_RLC_R8, &&mop_LD_RRC_Z_TO_pHL, &&mop_RRC_R8, &&mop_LD_RL_Z_TO_pHL,
+            &&mop_RL_R8, &&mop_LD_RR_Z_TO_pHL, &&mop_RR_R8, &&mop_LD_SLA_Z_TO_pHL, &&mop_SLA_R8,
+            &&mop_LD_SRA_Z_TO_pHL, &&mop_SRA_R8, &&mop_LD_SWAP_Z_TO_pHL, &&mop_SWAP_R8, &&mop_LD_SRL_Z_TO_pHL,
+            &&mop_SRL_R8, &&mop_BIT_Z, &&mop_BIT_R8, &&mop_RES_pHL, &&mop_RES_R8, &&mop_SET_pHL, &&mop_SET_R8,
+            &&mop_INVALID, &&mop_END };
+    static_assert( std::size( dispatchTable ) == std::to_underlying( MicroOperationType_t::END ) + 1 );
+    if( mop.type > MicroOperationType_t::END ) [[unlikely]]
+        goto MOP_DEFAULT;
+    goto* dispatchTable[std::to_underlying( mop.type )];
+    {
+#else
     switch( mop.type ) {
+#endif
         using enum MicroOperationType_t;
-    case NOP:
+    MOP_CASE( NOP ):
         [[likely]] return;
-    case STOP:
+    MOP_CASE( STOP ):
         //TODO
         return;
-    case LD_IMM_TO_Z:
-        Z = bus.read( PC++ );
-        break;
-    case LD_IMM_TO_W:
-        W = bus.read( PC++ );
-        break;
-    case LD_SPL_TO_pWZ:
+    MOP_CASE( LD_IMM_TO_Z ):
+        Z = fetchByte( PC++ );
+        return;
+    MOP_CASE( LD_IMM_TO_W ):
+        W = fetchByte( PC++ );
+        return;
+    MOP_CASE( LD_SPL_TO_pWZ ):
         bus.write( getWZ(), lsb( SP ) );
         setWZ( getWZ() + 1 );
-        break;
-    case LD_SPH_TO_pWZ:
+        return;
+    MOP_CASE( LD_SPH_TO_pWZ ):
         bus.write( getWZ(), msb( SP ) );
-        break;
-    case RLCA: {
-        const uint8_t value = readR8( Operand_t::a );
-        const bool cFlag    = value & ( 1 << 7 );
-
-        const uint8_t newValue = std::rotl( value, 1 );
-        writeR8( Operand_t::a, newValue );
-        setZNHCFlags( 0, 0, 0, cFlag );
-    } break;
-    case RRCA: {
-        const uint8_t value = readR8( Operand_t::a );
-        const bool cFlag    = value & 0x1;
-
-        const uint8_t newValue = std::rotr( value, 1 );
-        writeR8( Operand_t::a, newValue );
-        setZNHCFlags( 0, 0, 0, cFlag );
-    } break;
-    case RLA: {
-        const uint8_t value = readR8( Operand_t::a );
-        const bool cFlag    = value & ( 1 << 7 );
-
-        const uint8_t newValue = lsb( ( value << 1 ) | getCFlag() );
-        writeR8( Operand_t::a, newValue );
-        setZNHCFlags( 0, 0, 0, cFlag );
-    } break;
-    case RRA: {
-        const uint8_t value = readR8( Operand_t::a );
-        const bool cFlag    = value & 0x1;
-
-        const uint8_t newValue = lsb( ( getCFlag() << 7 ) | ( value >> 1 ) );
-        writeR8( Operand_t::a, newValue );
-        setZNHCFlags( 0, 0, 0, cFlag );
-    } break;
-    case DAA: {
-        const auto registerA = readR8( Operand_t::a );
-        uint8_t adjustment   = 0;
-        bool cFlag           = getCFlag();
-        if( getNFlag() ) {
-            if( getHFlag() )
-                adjustment += 6;
-            if( getCFlag() )
-                adjustment += 0x60;
-            writeR8( Operand_t::a, registerA - adjustment );
-        } else {
-            if( getHFlag() || ( registerA & 0xF ) > 9 )
-                adjustment += 6;
-            if( getCFlag() || registerA > 0x99 ) {
-                adjustment += 0x60;
-                cFlag = true;
-            }
-            writeR8( Operand_t::a, registerA + adjustment );
-        }
-        setZNHCFlags( ! readR8( Operand_t::a ), getNFlag(), 0, cFlag );
-    } break;
-    case CPL:
+        return;
+    MOP_CASE( RLCA ): {
+        const auto result = alu::shift( alu::Shift_t::RLC, readR8( Operand_t::a ), 0 );
+        writeR8( Operand_t::a, result.value );
+        setFlags( result.flags & bitMask::carryFlag );
+    } return;
+    MOP_CASE( RRCA ): {
+        const auto result = alu::shift( alu::Shift_t::RRC, readR8( Operand_t::a ), 0 );
+        writeR8( Operand_t::a, result.value );
+        setFlags( result.flags & bitMask::carryFlag );
+    } return;
+    MOP_CASE( RLA ): {
+        const auto result = alu::shift( alu::Shift_t::RL, readR8( Operand_t::a ), flags() );
+        writeR8( Operand_t::a, result.value );
+        setFlags( result.flags & bitMask::carryFlag );
+    } return;
+    MOP_CASE( RRA ): {
+        const auto result = alu::shift( alu::Shift_t::RR, readR8( Operand_t::a ), flags() );
+        writeR8( Operand_t::a, result.value );
+        setFlags( result.flags & bitMask::carryFlag );
+    } return;
+    MOP_CASE( DAA ): {
+        const auto result = alu::daa( readR8( Operand_t::a ), flags() );
+        writeR8( Operand_t::a, result.value );
+        setFlags( result.flags );
+    } return;
+    MOP_CASE( CPL ):
         writeR8( Operand_t::a, ~readR8( Operand_t::a ) );
         setNFlag( true );
         setHFlag( true );
-        break;
-    case SCF:
+        return;
+    MOP_CASE( SCF ):
         setZNHCFlags( getZFlag(), 0, 0, 1 );
-        break;
-    case CCF:
+        return;
+    MOP_CASE( CCF ):
         setZNHCFlags( getZFlag(), 0, 0, ! getCFlag() );
-        break;
-    case ALU_CALC_RELATIVE_JUMP: {
+        return;
+    MOP_CASE( ALU_CALC_RELATIVE_JUMP ): {
         const uint16_t tmp = static_cast<uint16_t>( PC + int8_t( Z ) );
         Z                  = lsb( tmp );
         W                  = msb( tmp );
-    } break;
-    case IDU_LD_WZ_PLUS_1_TO_PC:
+    } return;
+    MOP_CASE( IDU_LD_WZ_PLUS_1_TO_PC ):
         PC = getWZ();
-        break;
-    case HALT: {
+        return;
+    MOP_CASE( HALT ): {
         //interruptMasterEnabled = false; // GBCTR says so, but does it make sense?
         halted = true;
         // TODO halt bug
-    } break;
-    case ALU_ADD_Z_TO_A:
+    } return;
+    MOP_CASE( ALU_ADD_Z_TO_A ):
         addToR8( Operand_t::a, Z );
-        break;
-    case ALU_ADC_Z_TO_A:
+        return;
+    MOP_CASE( ALU_ADC_Z_TO_A ):
         addToR8( Operand_t::a, Z + getCFlag() );
-        break;
-    case ALU_SUB_Z_FROM_A:
+        return;
+    MOP_CASE( ALU_SUB_Z_FROM_A ):
         subFromR8( Operand_t::a, Z );
-        break;
-    case ALU_SBC_Z_FROM_A:
+        return;
+    MOP_CASE( ALU_SBC_Z_FROM_A ):
         subFromR8( Operand_t::a, getCFlag() + Z );
-        break;
-    case ALU_A_AND_Z: {
+        return;
+    MOP_CASE( ALU_A_AND_Z ): {
         const uint8_t result = readR8( Operand_t::a ) & Z;
         writeR8( Operand_t::a, result );
-        setZNHCFlags( ! result, 0, 1, 0 );
-    } break;
-    case ALU_A_XOR_Z: {
+        setFlagsOf( FlagsOperation_t::AND, result );
+    } return;
+    MOP_CASE( ALU_A_XOR_Z ): {
         const uint8_t result = readR8( Operand_t::a ) ^ Z;
         writeR8( Operand_t::a, result );
-        setZNHCFlags( ! result, 0, 0, 0 );
-    } break;
-    case ALU_A_OR_Z: {
+        setFlagsOf( FlagsOperation_t::OR, result );
+    } return;
+    MOP_CASE( ALU_A_OR_Z ): {
         const uint8_t result = readR8( Operand_t::a ) | Z;
         writeR8( Operand_t::a, result );
-        setZNHCFlags( ! result, 0, 0, 0 );
-    } break;
-    case ALU_A_CP_Z:
+        setFlagsOf( FlagsOperation_t::OR, result );
+    } return;
+    MOP_CASE( ALU_A_CP_Z ):
         logDebug( std::format( "Compare register A value <{}> with Z value {}", readR8( Operand_t::a ), Z ) );
         subFromR8( Operand_t::a, Z, true );
-        break;
-    case ALU_ADD_SPL_TO_Z:
+        return;
+    MOP_CASE( ALU_ADD_SPL_TO_Z ):
         Z = addU8ToU8( lsb( SP ), Z );
-        break;
-    case ALU_SPH_ADC_ADJ_TO_W: {
+        return;
+    MOP_CASE( ALU_SPH_ADC_ADJ_TO_W ): {
         const uint8_t adjustment = Z & ( 1 << 7 ) ? 0xFF : 0;
         W                        = addU8ToU8( msb( SP ), getCFlag() + adjustment );
         setZFlag( 0 );
         setNFlag( 0 );
-    } break;
-    case LD_WZ_TO_SP:
+    } return;
+    MOP_CASE( LD_WZ_TO_SP ):
         SP = getWZ();
-        break;
-    case POP_SP_TO_Z:
+        return;
+    MOP_CASE( POP_SP_TO_Z ):
         Z = bus.read( SP++ );
-        break;
-    case POP_SP_TO_W:
+        return;
+    MOP_CASE( POP_SP_TO_W ):
         W = bus.read( SP++ );
-        break;
-    case LD_WZ_TO_PC:
+        return;
+    MOP_CASE( LD_WZ_TO_PC ):
         PC = getWZ();
-        break;
-    case LD_WZ_TO_PC__ENABLE_IME:
+        return;
+    MOP_CASE( LD_WZ_TO_PC__ENABLE_IME ):
         PC                     = getWZ();
         interruptMasterEnabled = true;
-        break;
-    case JP_TO_HL:
+        return;
+    MOP_CASE( JP_TO_HL ):
         PC = readR16( Operand_t::hl );
-        break;
-    case SP_DEC:
+        return;
+    MOP_CASE( SP_DEC ):
         SP--;
-        break;
-    case LD_PCH_TO_SP:
+        return;
+    MOP_CASE( LD_PCH_TO_SP ):
         bus.write( SP--, msb( PC ) ); // go to next byte's address
-        break;
-    case LD_PCL_TO_SP__LD_WZ_TO_PC:
+        return;
+    MOP_CASE( LD_PCL_TO_SP__LD_WZ_TO_PC ):
         bus.write( SP, lsb( PC ) );
         PC = getWZ();
-        break;
-    case LD_A_TO_FF00_PLUS_C:
+        return;
+    MOP_CASE( LD_A_TO_FF00_PLUS_C ):
         bus.write( 0xFF00 | readR8( Operand_t::c ), readR8( Operand_t::a ) );
-        break;
-    case LD_A_TO_FF00_PLUS_Z:
+        return;
+    MOP_CASE( LD_A_TO_FF00_PLUS_Z ):
         bus.write( 0xFF00 | Z, readR8( Operand_t::a ) );
-        break;
-    case LD_A_TO_pWZ:
+        return;
+    MOP_CASE( LD_A_TO_pWZ ):
         bus.write( getWZ(), readR8( Operand_t::a ) );
-        break;
-    case LD_FF00_PLUS_C_TO_Z:
+        return;
+    MOP_CASE( LD_FF00_PLUS_C_TO_Z ):
         Z = bus.read( 0xFF00 | readR8( Operand_t::c ) );
-        break;
-    case LD_Z_TO_R8:
-        writeR8( mop.operand1, Z );
-        break;
-    case LD_FF00_PLUS_Z_TO_Z:
+        return;
+    MOP_CASE( LD_Z_TO_R8 ):
+        executeR8<LD_Z_TO_R8>( mop.operand1, mop.operand2 );
+        return;
+    MOP_CASE( LD_FF00_PLUS_Z_TO_Z ):
         Z = bus.read( 0xFF00 + Z );
-        break;
-    case LD_pWZ_TO_Z:
+        return;
+    MOP_CASE( LD_pWZ_TO_Z ):
         Z = bus.read( getWZ() );
-        break;
-    case ALU_SPL_PLUS_Z_TO_L:
+        return;
+    MOP_CASE( ALU_SPL_PLUS_Z_TO_L ):
         writeR8( Operand_t::l, addU8ToU8( lsb( SP ), Z ) );
-        break;
-    case ALU_SPH_ADC_ADJ_TO_H: {
+        return;
+    MOP_CASE( ALU_SPH_ADC_ADJ_TO_H ): {
         const uint8_t adjustment = Z & ( 1 << 7 ) ? 0xFF : 0;
         writeR8( Operand_t::h, addU8ToU8( msb( SP ), getCFlag() + adjustment ) );
         setZFlag( 0 );
         setNFlag( 0 );
-    } break;
-    case LD_HL_TO_SP:
+    } return;
+    MOP_CASE( LD_HL_TO_SP ):
         SP = readR16( Operand_t::hl );
-        break;
-    case DI:
+        return;
+    MOP_CASE( DI ):
         interruptMasterEnabled = false;
-        break;
-    case EI:
+        return;
+    MOP_CASE( EI ):
         enableIMELater = true;
-        break;
-    case COND_CHECK__LD_IMM_TO_Z:
+        return;
+    MOP_CASE( COND_CHECK__LD_IMM_TO_Z ):
         lastConditionCheck = isConditionMet( mop.operand1 );
-        Z                  = bus.read( PC++ );
-        break;
-    case INC_R8: {
-        const bool cFlag = getCFlag();
-        addToR8( mop.operand1, 1 );
-        setCFlag( cFlag );
-    } break;
-    case LD_pHL_TO_Z:
+        Z                  = fetchByte( PC++ );
+        return;
+    MOP_CASE( INC_R8 ):
+        executeR8<INC_R8>( mop.operand1, mop.operand2 );
+        return;
+    MOP_CASE( LD_pHL_TO_Z ):
         Z = bus.read( readR16( Operand_t::hl ) );
-        break;
-    case ALU_LD_Z_PLUS_1_TO_pHL:
+        return;
+    MOP_CASE( ALU_LD_Z_PLUS_1_TO_pHL ):
         bus.write( readR16( Operand_t::hl ), ++Z );
-        break;
-    case ALU_LD_Z_MINUS_1_TO_pHL:
+        return;
+    MOP_CASE( ALU_LD_Z_MINUS_1_TO_pHL ):
         bus.write( readR16( Operand_t::hl ), --Z );
-        break;
-    case DEC_R8: {
-        const bool cFlag = getCFlag();
-        subFromR8( mop.operand1, 1 );
-        setCFlag( cFlag );
-    } break;
-    case LD_Z_TO_pHL:
+        return;
+    MOP_CASE( DEC_R8 ):
+        executeR8<DEC_R8>( mop.operand1, mop.operand2 );
+        return;
+    MOP_CASE( LD_Z_TO_pHL ):
         bus.write( readR16( Operand_t::hl ), Z );
-        break;
-    case LD_WZ_TO_R16:
+        return;
+    MOP_CASE( LD_WZ_TO_R16 ):
         writeR16( mop.operand1, getWZ() );
-        break;
-    case LD_A_TO_R16_MEM:
+        return;
+    MOP_CASE( LD_A_TO_R16_MEM ):
         if( mop.operand1 == Operand_t::pBC || mop.operand1 == Operand_t::pDE )
             bus.write( readR16( mop.operand1 ), readR8( Operand_t::a ) );
         else {
@@ -248,18 +266,18 @@ void Cpu::execute( MicroOperation_t mop ) {
             mop.operand1 == Operand_t::hlPlus ? ++hl : --hl;
             writeR16( Operand_t::hl, hl );
         }
-        break;
-    case IDU_INC_R16: {
+        return;
+    MOP_CASE( IDU_INC_R16 ): {
         const uint16_t value = readR16( mop.operand1 );
         writeR16( mop.operand1, value + 1 );
-    } break;
-    case ALU_ADD_LSB_R16_TO_L: {
+    } return;
+    MOP_CASE( ALU_ADD_LSB_R16_TO_L ): {
         addToR8( Operand_t::l, lsb( readR16( mop.operand1 ) ) );
-    } break;
-    case ALU_ADC_MSB_R16_TO_H:
+    } return;
+    MOP_CASE( ALU_ADC_MSB_R16_TO_H ):
         addToR8( Operand_t::h, getCFlag() + msb( readR16( mop.operand1 ) ) );
-        break;
-    case LD_R16_MEM_TO_Z:
+        return;
+    MOP_CASE( LD_R16_MEM_TO_Z ):
         if( mop.operand1 == Operand_t::pBC || mop.operand1 == Operand_t::pDE )
             Z = bus.read( readR16( mop.operand1 ) );
         else {
@@ -268,214 +286,173 @@ void Cpu::execute( MicroOperation_t mop ) {
             mop.operand1 == Operand_t::hlPlus ? ++hl : --hl;
             writeR16( Operand_t::hl, hl );
         }
-        break;
-    case IDU_DEC_R16: {
+        return;
+    MOP_CASE( IDU_DEC_R16 ): {
         const uint16_t value = readR16( mop.operand1 );
         writeR16( mop.operand1, value - 1 );
-    } break;
-    case LD_R8_TO_R8: {
-        const uint8_t value = readR8( mop.operand2 );
-        writeR8( mop.operand1, value );
-    } break;
-    case LD_R8_TO_pHL:
-        bus.write( readR16( Operand_t::hl ), readR8( mop.operand1 ) );
-        break;
-    case ALU_ADD_R8_TO_A:
-        addToR8( Operand_t::a, readR8( mop.operand1 ) );
-        break;
-    case ALU_ADC_R8_TO_A:
-        addToR8( Operand_t::a, getCFlag() + readR8( mop.operand1 ) );
-        break;
-    case ALU_SUB_R8_FROM_A:
-        subFromR8( Operand_t::a, readR8( mop.operand1 ) );
-        break;
-    case ALU_SBC_R8_FROM_A:
-        subFromR8( Operand_t::a, getCFlag() + readR8( mop.operand1 ) );
-        break;
-    case ALU_A_AND_R8: {
-        const uint8_t result = readR8( Operand_t::a ) & readR8( mop.operand1 );
-        writeR8( Operand_t::a, result );
-        setZNHCFlags( ! result, 0, 1, 0 );
-    } break;
-    case ALU_A_XOR_R8: {
-        const uint8_t result = readR8( Operand_t::a ) ^ readR8( mop.operand1 );
-        writeR8( Operand_t::a, result );
-        setZNHCFlags( ! result, 0, 0, 0 );
-    } break;
-    case ALU_A_OR_R8: {
-        const uint8_t result = readR8( Operand_t::a ) | readR8( mop.operand1 );
-        writeR8( Operand_t::a, result );
-        setZNHCFlags( ! result, 0, 0, 0 );
-    } break;
-    case ALU_CP_A_R8:
-        subFromR8( Operand_t::a, readR8( mop.operand1 ), true );
-        break;
-    case CHECK_COND:
+    } return;
+    MOP_CASE( LD_R8_TO_R8 ):
+        executeR8<LD_R8_TO_R8>( mop.operand1, mop.operand2 );
+        return;
+    MOP_CASE( LD_R8_TO_pHL ):
+        executeR8<LD_R8_TO_pHL>( mop.operand1, mop.operand2 );
+        return;
+    MOP_CASE( ALU_ADD_R8_TO_A ):
+        executeR8<ALU_ADD_R8_TO_A>( mop.operand1, mop.operand2 );
+        return;
+    MOP_CASE( ALU_ADC_R8_TO_A ):
+        executeR8<ALU_ADC_R8_TO_A>( mop.operand1, mop.operand2 );
+        return;
+    MOP_CASE( ALU_SUB_R8_FROM_A ):
+        executeR8<ALU_SUB_R8_FROM_A>( mop.operand1, mop.operand2 );
+        return;
+    MOP_CASE( ALU_SBC_R8_FROM_A ):
+        executeR8<ALU_SBC_R8_FROM_A>( mop.operand1, mop.operand2 );
+        return;
+    MOP_CASE( ALU_A_AND_R8 ):
+        executeR8<ALU_A_AND_R8>( mop.operand1, mop.operand2 );
+        return;
+    MOP_CASE( ALU_A_XOR_R8 ):
+        executeR8<ALU_A_XOR_R8>( mop.operand1, mop.operand2 );
+        return;
+    MOP_CASE( ALU_A_OR_R8 ):
+        executeR8<ALU_A_OR_R8>( mop.operand1, mop.operand2 );
+        return;
+    MOP_CASE( ALU_CP_A_R8 ):
+        executeR8<ALU_CP_A_R8>( mop.operand1, mop.operand2 );
+        return;
+    MOP_CASE( CHECK_COND ):
         lastConditionCheck = isConditionMet( mop.operand1 );
-        break;
-    case COND_CHECK__LD_IMM_TO_W:
+        return;
+    MOP_CASE( COND_CHECK__LD_IMM_TO_W ):
         lastConditionCheck = isConditionMet( mop.operand1 );
-        W                  = bus.read( PC++ );
-        break;
-    case LD_PCL_TO_SP__LD_TGT3_TO_PC:
+        W                  = fetchByte( PC++ );
+        return;
+    MOP_CASE( LD_PCL_TO_SP__LD_TGT3_TO_PC ):
         bus.write( SP, lsb( PC ) );
         PC = std::to_underlying( mop.operand1 ) * 8;
-        break;
-    case LD_WZ_TO_R16STK:
-        registers[std::to_underlying( mop.operand1 ) * 2]     = W;
-        registers[std::to_underlying( mop.operand1 ) * 2 + 1] = Z;
-        break;
-    case PUSH_MSB_R16STK_TO_SP: {
-        const auto r16STKMsb = registers[std::to_underlying( mop.operand1 ) * 2];
+        return;
+    MOP_CASE( LD_WZ_TO_R16STK ):
+        if( mop.operand1 == Operand_t::af )
+            materializeFlags(); // drops pending lazy flags
+        writePair( std::to_underlying( mop.operand1 ), getWZ() );
+        return;
+    MOP_CASE( PUSH_MSB_R16STK_TO_SP ): {
+        const auto r16STKMsb = registers[msbIndex( std::to_underlying( mop.operand1 ) )];
         bus.write( SP--, r16STKMsb ); // go to next byte's address
-    } break;
-    case PUSH_LSB_R16STK_TO_SP: {
-        const auto r16STKLsb = registers[std::to_underlying( mop.operand1 ) * 2 + 1];
+    } return;
+    MOP_CASE( PUSH_LSB_R16STK_TO_SP ): {
+        if( mop.operand1 == Operand_t::af )
+            materializeFlags();
+        const auto r16STKLsb = registers[lsbIndex( std::to_underlying( mop.operand1 ) )];
         bus.write( SP, r16STKLsb );
-    } break;
-    case FETCH_SECOND_BYTE:
+    } return;
+    MOP_CASE( FETCH_SECOND_BYTE ):
         PC++;
-        break;
-    case LD_RLC_Z_TO_pHL: {
-        const bool cFlag = Z & ( 1 << 7 );
-        Z                = std::rotl( Z, 1 );
+        return;
+    MOP_CASE( LD_RLC_Z_TO_pHL ): {
+        const auto result = alu::shift( alu::Shift_t::RLC, Z, 0 );
+        Z                 = result.value;
         bus.write( readR16( Operand_t::hl ), Z );
-        setZNHCFlags( ! Z, 0, 0, cFlag );
-    } break;
-    case RLC_R8: {
-        const uint8_t value    = readR8( mop.operand1 );
-        const bool cFlag       = value & ( 1 << 7 );
-        const uint8_t newValue = std::rotl( value, 1 );
-        writeR8( mop.operand1, newValue );
-        setZNHCFlags( ! newValue, 0, 0, cFlag );
-    } break;
-    case LD_RRC_Z_TO_pHL: {
-        const bool cFlag = Z & 0x1;
-        Z                = std::rotr( Z, 1 );
+        setFlags( result.flags );
+    } return;
+    MOP_CASE( RLC_R8 ):
+        executeR8<RLC_R8>( mop.operand1, mop.operand2 );
+        return;
+    MOP_CASE( LD_RRC_Z_TO_pHL ): {
+        const auto result = alu::shift( alu::Shift_t::RRC, Z, 0 );
+        Z                 = result.value;
         bus.write( readR16( Operand_t::hl ), Z );
-        setZNHCFlags( ! Z, 0, 0, cFlag );
-    } break;
-    case RRC_R8: {
-        const uint8_t value    = readR8( mop.operand1 );
-        const bool cFlag       = value & 0x1;
-        const uint8_t newValue = std::rotr( value, 1 );
-        writeR8( mop.operand1, newValue );
-        setZNHCFlags( ! newValue, 0, 0, cFlag );
-    } break;
-    case LD_RL_Z_TO_pHL: {
-        const bool cFlag = Z & ( 1 << 7 );
-        Z                = lsb( Z << 1 ) | getCFlag();
+        setFlags( result.flags );
+    } return;
+    MOP_CASE( RRC_R8 ):
+        executeR8<RRC_R8>( mop.operand1, mop.operand2 );
+        return;
+    MOP_CASE( LD_RL_Z_TO_pHL ): {
+        const auto result = alu::shift( alu::Shift_t::RL, Z, flags() );
+        Z                 = result.value;
         bus.write( readR16( Operand_t::hl ), Z );
-        setZNHCFlags( ! Z, 0, 0, cFlag );
-    } break;
-    case RL_R8: {
-        const uint8_t value    = readR8( mop.operand1 );
-        const bool cFlag       = value & ( 1 << 7 );
-        const uint8_t newValue = lsb( ( value << 1 ) | getCFlag() );
-        writeR8( mop.operand1, newValue );
-        setZNHCFlags( ! newValue, 0, 0, cFlag );
-    } break;
-    case LD_RR_Z_TO_pHL: {
-        const bool cFlag = Z & 0x1;
-        Z                = lsb( getCFlag() << 7 | ( Z >> 1 ) );
+        setFlags( result.flags );
+    } return;
+    MOP_CASE( RL_R8 ):
+        executeR8<RL_R8>( mop.operand1, mop.operand2 );
+        return;
+    MOP_CASE( LD_RR_Z_TO_pHL ): {
+        const auto result = alu::shift( alu::Shift_t::RR, Z, flags() );
+        Z                 = result.value;
         bus.write( readR16( Operand_t::hl ), Z );
-        setZNHCFlags( ! Z, 0, 0, cFlag );
-    } break;
-    case RR_R8: {
-        const uint8_t value    = readR8( mop.operand1 );
-        const bool cFlag       = value & 0x1;
-        const uint8_t newValue = lsb( getCFlag() << 7 | ( value >> 1 ) );
-        writeR8( mop.operand1, newValue );
-        setZNHCFlags( ! newValue, 0, 0, cFlag );
-    } break;
-    case LD_SLA_Z_TO_pHL: {
-        const bool cFlag = Z & ( 1 << 7 );
-        Z                = lsb( Z << 1 );
+        setFlags( result.flags );
+    } return;
+    MOP_CASE( RR_R8 ):
+        executeR8<RR_R8>( mop.operand1, mop.operand2 );
+        return;
+    MOP_CASE( LD_SLA_Z_TO_pHL ): {
+        const auto result = alu::shift( alu::Shift_t::SLA, Z, 0 );
+        Z                 = result.value;
         bus.write( readR16( Operand_t::hl ), Z );
-        setZNHCFlags( ! Z, 0, 0, cFlag );
-    } break;
-    case SLA_R8: {
-        const uint8_t value    = readR8( mop.operand1 );
-        const bool cFlag       = value & ( 1 << 7 );
-        const uint8_t newValue = lsb( value << 1 );
-        writeR8( mop.operand1, newValue );
-        setZNHCFlags( ! newValue, 0, 0, cFlag );
-    } break;
-    case LD_SRA_Z_TO_pHL: {
-        const bool cFlag = Z & 0x1;
-        Z                = lsb( ( Z & ( 1 << 7 ) ) | ( Z >> 1 ) );
+        setFlags( result.flags );
+    } return;
+    MOP_CASE( SLA_R8 ):
+        executeR8<SLA_R8>( mop.operand1, mop.operand2 );
+        return;
+    MOP_CASE( LD_SRA_Z_TO_pHL ): {
+        const auto result = alu::shift( alu::Shift_t::SRA, Z, 0 );
+        Z                 = result.value;
         bus.write( readR16( Operand_t::hl ), Z );
-        setZNHCFlags( ! Z, 0, 0, cFlag );
-    } break;
-    case SRA_R8: {
-        const uint8_t value    = readR8( mop.operand1 );
-        const bool cFlag       = value & 0x1;
-        const uint8_t newValue = lsb( ( value & ( 1 << 7 ) ) | ( value >> 1 ) );
-        writeR8( mop.operand1, newValue );
-        setZNHCFlags( ! newValue, 0, 0, cFlag );
-    } break;
-    case LD_SWAP_Z_TO_pHL:
-        Z = lsb( ( Z << 4 ) | ( Z >> 4 ) );
+        setFlags( result.flags );
+    } return;
+    MOP_CASE( SRA_R8 ):
+        executeR8<SRA_R8>( mop.operand1, mop.operand2 );
+        return;
+    MOP_CASE( LD_SWAP_Z_TO_pHL ): {
+        const auto result = alu::shift( alu::Shift_t::SWAP, Z, 0 );
+        Z                 = result.value;
         bus.write( readR16( Operand_t::hl ), Z );
-        setZNHCFlags( ! Z, 0, 0, 0 );
-        break;
-    case SWAP_R8: {
-        const uint8_t value    = readR8( mop.operand1 );
-        const uint8_t newValue = lsb( ( value << 4 ) | ( value >> 4 ) );
-        writeR8( mop.operand1, newValue );
-        setZNHCFlags( ! newValue, 0, 0, 0 );
-    } break;
-    case LD_SRL_Z_TO_pHL: {
-        const bool cFlag = Z & 0x1;
-        Z                = Z >> 1;
+        setFlags( result.flags );
+    } return;
+    MOP_CASE( SWAP_R8 ):
+        executeR8<SWAP_R8>( mop.operand1, mop.operand2 );
+        return;
+    MOP_CASE( LD_SRL_Z_TO_pHL ): {
+        const auto result = alu::shift( alu::Shift_t::SRL, Z, 0 );
+        Z                 = result.value;
         bus.write( readR16( Operand_t::hl ), Z );
-        setZNHCFlags( ! Z, 0, 0, cFlag );
-    } break;
-    case SRL_R8: {
-        const uint8_t value    = readR8( mop.operand1 );
-        const bool cFlag       = value & 0x1;
-        const uint8_t newValue = value >> 1;
-        writeR8( mop.operand1, newValue );
-        setZNHCFlags( ! newValue, 0, 0, cFlag );
-    } break;
-    case BIT_Z: {
-        const bool bitSet = Z & ( 1 << std::to_underlying( mop.operand1 ) );
-        setZNHCFlags( ! bitSet, 0, 1, getCFlag() );
-    } break;
-    case BIT_R8: {
-        const uint8_t value = readR8( mop.operand2 );
-        const bool bitSet   = value & ( 1 << std::to_underlying( mop.operand1 ) );
-        setZNHCFlags( ! bitSet, 0, 1, getCFlag() );
-    } break;
-    case RES_pHL: {
+        setFlags( result.flags );
+    } return;
+    MOP_CASE( SRL_R8 ):
+        executeR8<SRL_R8>( mop.operand1, mop.operand2 );
+        return;
+    MOP_CASE( BIT_Z ):
+        setFlags( alu::bit( std::to_underlying( mop.operand1 ), Z, flags() ) );
+        return;
+    MOP_CASE( BIT_R8 ):
+        executeR8<BIT_R8>( mop.operand1, mop.operand2 );
+        return;
+    MOP_CASE( RES_pHL ): {
         const uint16_t addr    = readR16( Operand_t::hl );
         const uint8_t value    = bus.read( addr );
         const uint8_t newValue = value & static_cast<uint8_t>( ~( 1 << std::to_underlying( mop.operand1 ) ) );
         bus.write( addr, newValue );
-    } break;
-    case RES_R8: {
-        const uint8_t value    = readR8( mop.operand2 );
-        const uint8_t newValue = value & static_cast<uint8_t>( ~( 1 << std::to_underlying( mop.operand1 ) ) );
-        writeR8( mop.operand2, newValue );
-    } break;
-    case SET_pHL: {
+    } return;
+    MOP_CASE( RES_R8 ):
+        executeR8<RES_R8>( mop.operand1, mop.operand2 );
+        return;
+    MOP_CASE( SET_pHL ): {
         const uint16_t addr    = readR16( Operand_t::hl );
         const uint8_t value    = bus.read( addr );
         const uint8_t newValue = value | static_cast<uint8_t>( 1 << std::to_underlying( mop.operand1 ) );
         bus.write( addr, newValue );
-    } break;
-    case SET_R8: {
-        const uint8_t value    = readR8( mop.operand2 );
-        const uint8_t newValue = value | static_cast<uint8_t>( 1 << std::to_underlying( mop.operand1 ) );
-        writeR8( mop.operand2, newValue );
-    } break;
-    case INVALID:
-        [[unlikely]] break;
-    case END:
+    } return;
+    MOP_CASE( SET_R8 ):
+        executeR8<SET_R8>( mop.operand1, mop.operand2 );
+        return;
+    MOP_CASE( INVALID ):
+        [[unlikely]] return;
+    MOP_CASE( END ):
         [[unlikely]] logFatal( ErrorCode::emptyMicroCodeExecuted, "Empty microcode executed! ( not NOP )" );
         logStacktrace();
         std::abort();
-    default:
+    MOP_DEFAULT:
         [[unlikely]] logFatal(
                 ErrorCode::InvalidOperand,
                 std::format( "Unknown microcode executed, value: {0}", std::to_underlying( mop.type ) ) );
@@ -483,3 +460,9 @@ void Cpu::execute( MicroOperation_t mop ) {
         std::abort();
     }
 }
+
+#ifdef COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+#undef MOP_CASE
+#undef MOP_DEFAULT
@@ -0,0 +1,54 @@
+#include "core/execution_profile.hpp"
+#include "core/cpu.hpp"
+#include "core/core_utils.hpp"
+#include "core/logging.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <string>
+
+#ifdef CPU_PROFILING
+namespace {
+std::string opcodeName( const std::size_t opcode ) {
+    if( opcode < 0x100 )
+        return toHex( lsb( opcode ) );
+    return "0xCB " + toHex( lsb( opcode ) );
+}
+std::string microOperationName( const std::size_t type ) {
+    return std::string( Cpu::microOperationName( static_cast<Cpu::MicroOperationType_t>( type ) ) );
+}
+} // namespace
+
+std::string ExecutionProfile::toCsv() const {
+    std::string csv = "kind,name,executions,t_cycles\n";
+    const auto addRows = [&]( const auto& counters, const char* kind, const auto& nameOf ) {
+        for( std::size_t i = 0; i < counters.size(); i++ )
+            if( counters[i].executions )
+                csv += std::format( "{},{},{},{}\n", kind, nameOf( i ), counters[i].executions,
+                                    counters[i].tCycles );
+    };
+    addRows( opcodes, "opcode", opcodeName );
+    addRows( microOperations, "micro_operation", microOperationName );
+    csv += std::format( "interrupt,dispatch,{},{}\n", interrupts.executions, interrupts.tCycles );
+    return csv;
+}
+
+std::string ExecutionProfile::toJson() const {
+    const auto array = [&]( const auto& counters, const auto& nameOf ) {
+        std::string entries;
+        for( std::size_t i = 0; i < counters.size(); i++ ) {
+            if( ! counters[i].executions )
+                continue;
+            if( ! entries.empty() )
+                entries += ",\n";
+            entries += std::format( "    {{ \"name\": \"{}\", \"executions\": {}, \"tCycles\": {} }}",
+                                    nameOf( i ), counters[i].executions, counters[i].tCycles );
+        }
+        return "[\n" + entries + "\n  ]";
+    };
+    return std::format( "{{\n  \"opcodes\": {},\n  \"microOperations\": {},\n"
+                        "  \"interrupts\": {{ \"executions\": {}, \"tCycles\": {} }}\n}}\n",
+                        array( opcodes, opcodeName ), array( microOperations, microOperationName ),
+                        interrupts.executions, interrupts.tCycles );
+}
+#endif
@@ -0,0 +1,455 @@
+#include "core/fast_cpu.hpp"
+#include "core/alu_tables.hpp"
+#include "core/core_constants.hpp"
+#include "core/logging.hpp"
+#include <cstdint>
+#include <array>
+#include <format>
+#include <utility>
+
+// Opcode groups follow https://gbdev.io/pandocs/CPU_Instruction_Set.html, the same way as cpu_decode.cpp
+
+void FastCpu::push( uint16_t value ) {
+    bus.write( --SP, msb( value ) );
+    bus.write( --SP, lsb( value ) );
+}
+
+uint16_t FastCpu::pop() {
+    const uint8_t low = bus.read( SP++ );
+    return static_cast<uint16_t>( ( bus.read( SP++ ) << 8 ) | low );
+}
+
+uint8_t FastCpu::readOperand( uint8_t code ) {
+    if( isPHL( Operand_t( code ) ) )
+        return bus.read( readR16( Operand_t::hl ) );
+    return readR8( Operand_t( code ) );
+}
+
+void FastCpu::writeOperand( uint8_t code, uint8_t value ) {
+    if( isPHL( Operand_t( code ) ) )
+        bus.write( readR16( Operand_t::hl ), value );
+    else
+        writeR8( Operand_t( code ), value );
+}
+
+//--------------------------------------------------
+void FastCpu::aluAdc( uint8_t value ) {
+    const uint8_t registerA = readR8( Operand_t::a );
+    const uint8_t carry     = getCFlag();
+    writeR8( Operand_t::a, lsb( registerA + value + carry ) );
+    setFlagsOf( FlagsOperation_t::ADD, registerA, value, carry );
+}
+
+void FastCpu::aluSbc( uint8_t value ) {
+    const uint8_t registerA = readR8( Operand_t::a );
+    const uint8_t carry     = getCFlag();
+    writeR8( Operand_t::a, lsb( registerA - value - carry ) );
+    setFlagsOf( FlagsOperation_t::SUB, registerA, value, carry );
+}
+
+void FastCpu::alu( uint8_t operation, uint8_t value ) {
+    switch( operation ) {
+    case 0:
+        addToR8( Operand_t::a, value );
+        break;
+    case 1:
+        aluAdc( value );
+        break;
+    case 2:
+        subFromR8( Operand_t::a, value );
+        break;
+    case 3:
+        aluSbc( value );
+        break;
+    case 4:
+        writeR8( Operand_t::a, readR8( Operand_t::a ) & value );
+        setFlagsOf( FlagsOperation_t::AND, readR8( Operand_t::a ) );
+        break;
+    case 5:
+        writeR8( Operand_t::a, readR8( Operand_t::a ) ^ value );
+        setFlagsOf( FlagsOperation_t::OR, readR8( Operand_t::a ) );
+        break;
+    case 6:
+        writeR8( Operand_t::a, readR8( Operand_t::a ) | value );
+        setFlagsOf( FlagsOperation_t::OR, readR8( Operand_t::a ) );
+        break;
+    case 7:
+        subFromR8( Operand_t::a, value, true );
+        break;
+    default:
+        std::unreachable();
+    }
+}
+
+uint8_t FastCpu::inc8( uint8_t value ) {
+    const uint8_t result = value + 1;
+    setZNHCFlags( ! result, false, ( value & 0xF ) == 0xF, getCFlag() );
+    return result;
+}
+
+uint8_t FastCpu::dec8( uint8_t value ) {
+    const uint8_t result = value - 1;
+    setZNHCFlags( ! result, true, ( value & 0xF ) == 0, getCFlag() );
+    return result;
+}
+
+void FastCpu::addToHL( uint16_t value ) {
+    const uint16_t registerHL = readR16( Operand_t::hl );
+    const bool halfCarry      = ( registerHL & 0xFFF ) + ( value & 0xFFF ) > 0xFFF;
+    const bool carry          = registerHL + value > 0xFFFF;
+    writeR16( Operand_t::hl, static_cast<uint16_t>( registerHL + value ) );
+    setZNHCFlags( getZFlag(), false, halfCarry, carry );
+}
+
+uint16_t FastCpu::addSignedToSP() {
+    const uint8_t offset = fetch();
+    // Flags come from the unsigned addition to the low byte
+    const bool halfCarry = ( SP & 0xF ) + ( offset & 0xF ) > 0xF;
+    const bool carry     = ( SP & 0xFF ) + offset > 0xFF;
+    setZNHCFlags( false, false, halfCarry, carry );
+    return static_cast<uint16_t>( SP + static_cast<int8_t>( offset ) );
+}
+
+void FastCpu::daa() {
+    const auto result = alu::daa( readR8( Operand_t::a ), flags() );
+    writeR8( Operand_t::a, result.value );
+    setFlags( result.flags );
+}
+
+//--------------------------------------------------
+void FastCpu::executeBlock0( uint8_t opcode ) {
+    const auto r16  = Operand_t( ( opcode >> 4 ) & 0x3 );
+    const auto r8   = static_cast<uint8_t>( ( opcode >> 3 ) & 0x7 );
+    const auto cond = Operand_t( ( opcode >> 3 ) & 0x3 );
+
+    switch( opcode & 0x7 ) {
+    case 0:
+        switch( opcode ) {
+        case 0x00: // NOP
+            break;
+        case 0x08: { // LD [imm16], SP
+            const uint16_t address = fetch16();
+            bus.write( address, lsb( SP ) );
+            bus.write( static_cast<uint16_t>( address + 1 ), msb( SP ) );
+        } break;
+        case 0x10: // STOP
+            //TODO
+            break;
+        case 0x18: { // JR imm8
+            const auto offset = static_cast<int8_t>( fetch() );
+            PC                = static_cast<uint16_t>( PC + offset );
+        } break;
+        default: { // JR cond, imm8
+            const auto offset = static_cast<int8_t>( fetch() );
+            if( isConditionMet( cond ) ) {
+                PC          = static_cast<uint16_t>( PC + offset );
+                branchTaken = true;
+            }
+        } break;
+        }
+        break;
+    case 1:
+        if( opcode & 0x8 ) // ADD HL, r16
+            addToHL( readR16( r16 ) );
+        else // LD r16, imm16
+            writeR16( r16, fetch16() );
+        break;
+    case 2: { // LD [r16mem], A / LD A, [r16mem]
+        uint16_t address;
+        switch( Operand_t( ( opcode >> 4 ) & 0x3 ) ) {
+            using enum Operand_t;
+        case pBC:
+            address = readR16( bc );
+            break;
+        case pDE:
+            address = readR16( de );
+            break;
+        case hlPlus:
+            address = readR16( hl );
+            writeR16( hl, static_cast<uint16_t>( address + 1 ) );
+            break;
+        case hlMinus:
+            address = readR16( hl );
+            writeR16( hl, static_cast<uint16_t>( address - 1 ) );
+            break;
+        default:
+            std::unreachable();
+        }
+        if( opcode & 0x8 )
+            writeR8( Operand_t::a, bus.read( address ) );
+        else
+            bus.write( address, readR8( Operand_t::a ) );
+    } break;
+    case 3: // INC r16 / DEC r16
+        writeR16( r16, static_cast<uint16_t>( opcode & 0x8 ? readR16( r16 ) - 1 : readR16( r16 ) + 1 ) );
+        break;
+    case 4: // INC r8
+        writeOperand( r8, inc8( readOperand( r8 ) ) );
+        break;
+    case 5: // DEC r8
+        writeOperand( r8, dec8( readOperand( r8 ) ) );
+        break;
+    case 6: // LD r8, imm8
+        writeOperand( r8, fetch() );
+        break;
+    case 7: {
+        const uint8_t registerA = readR8( Operand_t::a );
+        switch( opcode ) {
+        case 0x07: // RLCA
+        case 0x0F: // RRCA
+        case 0x17: // RLA
+        case 0x1F: { // RRA, same as CB prefixed RLC, RRC, RL and RR but with Z cleared
+            const auto result = alu::shift( static_cast<alu::Shift_t>( opcode >> 3 ), registerA, flags() );
+            writeR8( Operand_t::a, result.value );
+            setFlags( result.flags & bitMask::carryFlag );
+        } break;
+        case 0x27:
+            daa();
+            break;
+        case 0x2F: // CPL
+            writeR8( Operand_t::a, static_cast<uint8_t>( ~registerA ) );
+            setNFlag( true );
+            setHFlag( true );
+            break;
+        case 0x37: // SCF
+            setZNHCFlags( getZFlag(), false, false, true );
+            break;
+        case 0x3F: // CCF
+            setZNHCFlags( getZFlag(), false, false, ! getCFlag() );
+            break;
+        default:
+            std::unreachable();
+        }
+    } break;
+    default:
+        std::unreachable();
+    }
+}
+
+void FastCpu::executeBlock3( uint8_t opcode ) {
+    const auto cond = Operand_t( ( opcode >> 3 ) & 0x3 );
+
+    switch( opcode ) {
+    case 0xC0:
+    case 0xC8:
+    case 0xD0:
+    case 0xD8: // RET cond
+        if( isConditionMet( cond ) ) {
+            PC          = pop();
+            branchTaken = true;
+        }
+        break;
+    case 0xC9: // RET
+        PC = pop();
+        break;
+    case 0xD9: // RETI
+        PC                     = pop();
+        interruptMasterEnabled = true;
+        break;
+    case 0xC2:
+    case 0xCA:
+    case 0xD2:
+    case 0xDA: { // JP cond, imm16
+        const uint16_t address = fetch16();
+        if( isConditionMet( cond ) ) {
+            PC          = address;
+            branchTaken = true;
+        }
+    } break;
+    case 0xC3: // JP imm16
+        PC = fetch16();
+        break;
+    case 0xE9: // JP HL
+        PC = readR16( Operand_t::hl );
+        break;
+    case 0xC4:
+    case 0xCC:
+    case 0xD4:
+    case 0xDC: { // CALL cond, imm16
+        const uint16_t address = fetch16();
+        if( isConditionMet( cond ) ) {
+            push( PC );
+            PC          = address;
+            branchTaken = true;
+        }
+    } break;
+    case 0xCD: { // CALL imm16
+        const uint16_t address = fetch16();
+        push( PC );
+        PC = address;
+    } break;
+    case 0xC7:
+    case 0xCF:
+    case 0xD7:
+    case 0xDF:
+    case 0xE7:
+    case 0xEF:
+    case 0xF7:
+    case 0xFF: // RST tgt3
+        push( PC );
+        PC = opcode & 0x38;
+        break;
+    case 0xC1:
+    case 0xD1:
+    case 0xE1: // POP r16stk
+        writeR16( Operand_t( ( opcode >> 4 ) & 0x3 ), pop() );
+        break;
+    case 0xF1: { // POP AF, lower nibble of F doesn't exist
+        const uint16_t value = pop();
+        writeR8( Operand_t::a, msb( value ) );
+        writeR8( Operand_t::f, lsb( value ) & 0xF0 );
+    } break;
+    case 0xC5:
+    case 0xD5:
+    case 0xE5: // PUSH r16stk
+        push( readR16( Operand_t( ( opcode >> 4 ) & 0x3 ) ) );
+        break;
+    case 0xF5: // PUSH AF
+        push( static_cast<uint16_t>( ( readR8( Operand_t::a ) << 8 ) | readR8( Operand_t::f ) ) );
+        break;
+    case 0xC6:
+    case 0xCE:
+    case 0xD6:
+    case 0xDE:
+    case 0xE6:
+    case 0xEE:
+    case 0xF6:
+    case 0xFE: // ALU A, imm8
+        alu( ( opcode >> 3 ) & 0x7, fetch() );
+        break;
+    case 0xE0: // LDH [imm8], A
+        bus.write( static_cast<uint16_t>( addr::ioRegisters + fetch() ), readR8( Operand_t::a ) );
+        break;
+    case 0xF0: // LDH A, [imm8]
+        writeR8( Operand_t::a, bus.read( static_cast<uint16_t>( addr::ioRegisters + fetch() ) ) );
+        break;
+    case 0xE2: // LDH [C], A
+        bus.write( static_cast<uint16_t>( addr::ioRegisters + readR8( Operand_t::c ) ),
+                   readR8( Operand_t::a ) );
+        break;
+    case 0xF2: // LDH A, [C]
+        writeR8( Operand_t::a,
+                 bus.read( static_cast<uint16_t>( addr::ioRegisters + readR8( Operand_t::c ) ) ) );
+        break;
+    case 0xEA: // LD [imm16], A
+        bus.write( fetch16(), readR8( Operand_t::a ) );
+        break;
+    case 0xFA: // LD A, [imm16]
+        writeR8( Operand_t::a, bus.read( fetch16() ) );
+        break;
+    case 0xE8: // ADD SP, imm8
+        SP = addSignedToSP();
+        break;
+    case 0xF8: // LD HL, SP + imm8
+        writeR16( Operand_t::hl, addSignedToSP() );
+        break;
+    case 0xF9: // LD SP, HL
+        SP = readR16( Operand_t::hl );
+        break;
+    case 0xF3: // DI
+        interruptMasterEnabled = false;
+        enableIMELater         = false;
+        break;
+    case 0xFB: // EI
+        enableIMELater = true;
+        break;
+    default:
+        [[unlikely]] logWarning( ErrorCode::CPUHardLocked,
+                                 std::format( "Invalid opcode {} executed as NOP", toHex( opcode ) ) );
+        break;
+    }
+}
+
+void FastCpu::executeCB( uint8_t opcode ) {
+    const uint8_t code  = opcode & 0x7;
+    const uint8_t bit   = ( opcode >> 3 ) & 0x7;
+    const uint8_t value = readOperand( code );
+
+    switch( opcode >> 6 ) {
+    case 0: { // RLC, RRC, RL, RR, SLA, SRA, SWAP, SRL
+        const auto result = alu::shift( static_cast<alu::Shift_t>( bit ), value, flags() );
+        writeOperand( code, result.value );
+        setFlags( result.flags );
+    } break;
+    case 1: // BIT
+        setFlags( alu::bit( bit, value, flags() ) );
+        break;
+    case 2: // RES
+        writeOperand( code, lsb( value & ~( 1 << bit ) ) );
+        break;
+    case 3: // SET
+        writeOperand( code, lsb( value | ( 1 << bit ) ) );
+        break;
+    default:
+        std::unreachable();
+    }
+}
+
+//--------------------------------------------------
+template<uint16_t index>
+unsigned FastCpu::executeOpcode() {
+    if constexpr( index > 0xFF ) {
+        executeCB( lsb( index ) );
+        return cycles::opcodeCyclesCb[lsb( index )];
+    } else {
+        constexpr uint8_t opcode = index;
+        branchTaken              = false;
+        if constexpr( opcode >> 6 == 0 )
+            executeBlock0( opcode );
+        else if constexpr( opcode == 0x76 ) // HALT
+            halted = true;
+        else if constexpr( opcode >> 6 == 1 ) // LD r8, r8
+            writeOperand( ( opcode >> 3 ) & 0x7, readOperand( opcode & 0x7 ) );
+        else if constexpr( opcode >> 6 == 2 ) // ALU A, r8
+            alu( ( opcode >> 3 ) & 0x7, readOperand( opcode & 0x7 ) );
+        else
+            executeBlock3( opcode );
+        // Invalid opcodes have no cycles listed, they take one M-cycle like the INVALID micro-operation
+        if constexpr( cycles::opcodeCycles[opcode] == 0 )
+            return 4;
+        return branchTaken ? cycles::opcodeCyclesBranched[opcode] : cycles::opcodeCycles[opcode];
+    }
+}
+
+template<std::size_t... indices>
+constexpr std::array<FastCpu::Handler_t, 512> FastCpu::makeHandlers( std::index_sequence<indices...> ) {
+    return { &FastCpu::executeOpcode<indices>... };
+}
+
+const std::array<FastCpu::Handler_t, 512> FastCpu::handlers = makeHandlers( std::make_index_sequence<512> {} );
+
+unsigned FastCpu::serviceInterrupts() {
+    if( halted ) {
+        if( ! pendingInterrupts() )
+            return 4;
+        halted = false;
+    }
+    if( acceptInterrupt() ) {
+        push( PC );
+        PC = getWZ();
+        return 20; // Same five M-cycles as the micro-operation dispatch
+    }
+    return 0;
+}
+
+unsigned FastCpu::executeInstruction() {
+    const bool enableIMEAfterThis           = enableIMELater;
+    [[maybe_unused]] const uint16_t address = PC; // of the opcode, for the log
+    uint16_t index                          = fetch();
+    if( index == 0xCB )
+        index = static_cast<uint16_t>( 0x100 | fetch() );
+    logDebug( std::format( "PC: {} - Executing opcode {}", toHex( address ), toHex( index ) ) );
+
+    const unsigned tCycles = ( this->*handlers[index] )();
+    applyDelayedIME( enableIMEAfterThis );
+#ifdef CPU_PROFILING
+    profile.countOpcode( index, tCycles );
+#endif
+    return tCycles;
+}
+
+unsigned FastCpu::tick() {
+    if( const unsigned tCycles = serviceInterrupts() )
+        return tCycles;
+    return executeInstruction();
+}
@@ -0,0 +1,1056 @@
+#include "core/jit_cpu.hpp"
+#include "core/core_constants.hpp"
+#include "core/logging.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace {
+// x86-64 register numbers
+enum Reg : uint8_t { rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi, r8, r9, r10, r11, r12, r13, r14, r15 };
+
+// Emulated registers live in callee saved registers, so helper calls preserve them.
+// A and F are zero extended bytes, pairs are 16-bit values with the first register in the high byte.
+constexpr Reg regA  = rbx;
+constexpr Reg regF  = rbp;
+constexpr Reg regBC = r12;
+constexpr Reg regDE = r13;
+constexpr Reg regHL = r14;
+constexpr Reg regSP = r15;
+
+// Extension digit of the x86 ALU instruction group, also encodes the register-register forms
+enum class Alu : uint8_t { add = 0, or_ = 1, adc = 2, sbb = 3, and_ = 4, sub = 5, xor_ = 6, cmp = 7 };
+enum class Shift : uint8_t { rol = 0, shl = 4, shr = 5 };
+enum class Cond : uint8_t { equal = 0x4, notEqual = 0x5, above = 0x7 };
+
+// Compiled code is larger than this only if something went very wrong
+constexpr std::size_t maxCompiledBlockSize = 32 * 1024;
+
+constexpr bool isDirectlyAccessible( const uint32_t address ) {
+    return address < addr::videoRam ||
+           ( addr::externalRam <= address && address < addr::objectAttributeMemory ) ||
+           ( addr::highRam <= address && address < addr::interruptEnableRegister );
+}
+
+// Code buffer is never writable and executable at once, pages of a block are writable only while
+// it's copied in. Sets protection of the pages overlapping buffer[begin, end).
+bool protectPages( uint8_t* buffer, const std::size_t begin, const std::size_t end, const int protection ) {
+    static const auto pageSize  = static_cast<std::size_t>( sysconf( _SC_PAGESIZE ) );
+    const std::size_t firstPage = begin & ~( pageSize - 1 );
+    return mprotect( buffer + firstPage, end - firstPage, protection ) == 0;
+}
+
+//--------------------------------------------------
+class Emitter {
+public:
+    std::vector<uint8_t> code;
+
+    void byte( const unsigned value ) {
+        code.push_back( static_cast<uint8_t>( value ) );
+    }
+    void dword( const uint32_t value ) {
+        for( unsigned i = 0; i < 4; i++ )
+            byte( ( value >> ( 8 * i ) ) & 0xFF );
+    }
+    void qword( const uint64_t value ) {
+        dword( static_cast<uint32_t>( value ) );
+        dword( static_cast<uint32_t>( value >> 32 ) );
+    }
+    // forceRex makes rm encode spl/bpl/sil/dil instead of ah/ch/dh/bh in byte instructions
+    void rex( const bool wide, const unsigned reg, const unsigned rm, const bool forceRex = false ) {
+        const unsigned value = 0x40 | ( wide << 3 ) | ( ( reg >> 3 ) << 2 ) | ( rm >> 3 );
+        if( value != 0x40 || forceRex )
+            byte( value );
+    }
+    void modrm( const unsigned reg, const unsigned rm ) {
+        byte( 0xC0 | ( ( reg & 7 ) << 3 ) | ( rm & 7 ) );
+    }
+    // [rdi + displacement]
+    void modrmCpu( const unsigned reg, const uint32_t displacement ) {
+        byte( 0x80 | ( ( reg & 7 ) << 3 ) | rdi );
+        dword( displacement );
+    }
+
+    void mov( const Reg dst, const Reg src ) {
+        rex( false, src, dst );
+        byte( 0x89 );
+        modrm( src, dst );
+    }
+    void movImm( const Reg dst, const uint32_t value ) {
+        rex( false, 0, dst );
+        byte( 0xB8 + ( dst & 7 ) );
+        dword( value );
+    }
+    void movImm64( const Reg dst, const uint64_t value ) {
+        rex( true, 0, dst );
+        byte( 0xB8 + ( dst & 7 ) );
+        qword( value );
+    }
+    void alu( const Alu op, const Reg dst, const Reg src ) {
+        rex( false, src, dst );
+        byte( static_cast<unsigned>( op ) * 8 + 1 );
+        modrm( src, dst );
+    }
+    void aluImm( const Alu op, const Reg dst, const uint32_t value ) {
+        rex( false, 0, dst );
+        if( value < 0x80 ) {
+            byte( 0x83 );
+            modrm( static_cast<unsigned>( op ), dst );
+            byte( value );
+        } else {
+            byte( 0x81 );
+            modrm( static_cast<unsigned>( op ), dst );
+            dword( value );
+        }
+    }
+    // Byte operation on al and cl only, they need no REX prefix
+    void alu8( const Alu op, const Reg dst, const Reg src ) {
+        byte( static_cast<unsigned>( op ) * 8 );
+        modrm( src, dst );
+    }
+    void inc8( const Reg reg ) {
+        byte( 0xFE );
+        modrm( 0, reg );
+    }
+    void dec8( const Reg reg ) {
+        byte( 0xFE );
+        modrm( 1, reg );
+    }
+    void shift( const Shift op, const Reg reg, const uint8_t count ) {
+        rex( false, 0, reg );
+        byte( 0xC1 );
+        modrm( static_cast<unsigned>( op ), reg );
+        byte( count );
+    }
+    void movzx8( const Reg dst, const Reg src ) {
+        rex( false, dst, src, src >= rsp && src <= rdi );
+        byte( 0x0F );
+        byte( 0xB6 );
+        modrm( dst, src );
+    }
+    void movzx16( const Reg dst, const Reg src ) {
+        rex( false, dst, src );
+        byte( 0x0F );
+        byte( 0xB7 );
+        modrm( dst, src );
+    }
+    // movzx dst, ah ( dst must not need REX )
+    void movzxAH( const Reg dst ) {
+        byte( 0x0F );
+        byte( 0xB6 );
+        modrm( dst, 4 );
+    }
+    void lahf() {
+        byte( 0x9F );
+    }
+    // Copies bit of reg to x86 carry flag
+    void bt( const Reg reg, const uint8_t bit ) {
+        rex( false, 0, reg );
+        byte( 0x0F );
+        byte( 0xBA );
+        modrm( 4, reg );
+        byte( bit );
+    }
+    void test( const Reg a, const Reg b ) {
+        rex( false, b, a );
+        byte( 0x85 );
+        modrm( b, a );
+    }
+    void testImm( const Reg reg, const uint32_t value ) {
+        rex( false, 0, reg );
+        byte( 0xF7 );
+        modrm( 0, reg );
+        dword( value );
+    }
+    // Byte register without REX only ( al, cl, dl, bl )
+    void setcc( const Cond cond, const Reg reg ) {
+        byte( 0x0F );
+        byte( 0x90 + static_cast<unsigned>( cond ) );
+        modrm( 0, reg );
+    }
+
+    void loadCpu8( const Reg dst, const uint32_t displacement ) {
+        rex( false, dst, rdi );
+        byte( 0x0F );
+        byte( 0xB6 );
+        modrmCpu( dst, displacement );
+    }
+    void loadCpu16( const Reg dst, const uint32_t displacement ) {
+        rex( false, dst, rdi );
+        byte( 0x0F );
+        byte( 0xB7 );
+        modrmCpu( dst, displacement );
+    }
+    void storeCpu8( const uint32_t displacement, const Reg src ) {
+        rex( false, src, rdi, src >= rsp && src <= rdi );
+        byte( 0x88 );
+        modrmCpu( src, displacement );
+    }
+    void storeCpu16( const uint32_t displacement, const Reg src ) {
+        byte( 0x66 );
+        rex( false, src, rdi );
+        byte( 0x89 );
+        modrmCpu( src, displacement );
+    }
+    void storeCpuImm16( const uint32_t displacement, const uint16_t value ) {
+        byte( 0x66 );
+        byte( 0xC7 );
+        modrmCpu( 0, displacement );
+        byte( value & 0xFF );
+        byte( value >> 8 );
+    }
+
+    void push( const Reg reg ) {
+        rex( false, 0, reg );
+        byte( 0x50 + ( reg & 7 ) );
+    }
+    void pop( const Reg reg ) {
+        rex( false, 0, reg );
+        byte( 0x58 + ( reg & 7 ) );
+    }
+    // Stack slot holding the JitCpu pointer, stack is 16-byte aligned after the prologue
+    void storeCpuPointer() {
+        for( const unsigned value: { 0x48, 0x89, 0x3C, 0x24 } ) // mov [rsp], rdi
+            byte( value );
+    }
+    void loadCpuPointer() {
+        for( const unsigned value: { 0x48, 0x8B, 0x3C, 0x24 } ) // mov rdi, [rsp]
+            byte( value );
+    }
+    void adjustStack( const bool reserve ) {
+        byte( 0x48 );
+        byte( 0x83 );
+        modrm( reserve ? static_cast<unsigned>( Alu::sub ) : static_cast<unsigned>( Alu::add ), rsp );
+        byte( 8 );
+    }
+    void call( const uint64_t target ) {
+        movImm64( rax, target );
+        byte( 0xFF );
+        modrm( 2, rax );
+    }
+    void ret() {
+        byte( 0xC3 );
+    }
+    // Jumps return position of their rel32 for patch()
+    std::size_t jcc( const Cond cond ) {
+        byte( 0x0F );
+        byte( 0x80 + static_cast<unsigned>( cond ) );
+        dword( 0 );
+        return code.size() - 4;
+    }
+    std::size_t jmp() {
+        byte( 0xE9 );
+        dword( 0 );
+        return code.size() - 4;
+    }
+    void patch( const std::size_t position, const std::size_t target ) {
+        const auto relative = static_cast<uint32_t>( target - ( position + 4 ) );
+        std::memcpy( code.data() + position, &relative, sizeof( relative ) );
+    }
+};
+
+//--------------------------------------------------
+struct CompilerContext {
+    uint32_t registersOffset; // pairs in host byte order
+    uint32_t aOffset;
+    uint32_t fOffset;
+    uint32_t spOffset;
+    uint32_t pcOffset;
+    uint64_t readHelper;
+    uint64_t read16Helper;
+    uint64_t writeHelper;
+    uint64_t write16Helper;
+};
+
+// Translates instructions of one block, every instruction keeps T-cycles of the ones before it
+class BlockCompiler {
+    struct Exit {
+        std::size_t jumpPosition;
+        uint16_t pc;
+        unsigned tCycles;
+        bool pcInEcx;
+    };
+
+    Emitter emitter;
+    const CompilerContext& context;
+    std::vector<Exit> exits;
+
+    // Instruction being translated
+    uint16_t pc;
+    uint16_t nextPc;
+    unsigned tCyclesBefore = 0;
+    unsigned longestExit   = 0;
+
+    void addExit( const std::size_t jumpPosition, const uint16_t exitPc, const unsigned tCycles,
+                  const bool pcInEcx = false ) {
+        exits.push_back( { jumpPosition, exitPc, tCycles, pcInEcx } );
+        longestExit = std::max( longestExit, tCycles );
+    }
+    void exitIf( const Cond cond, const uint16_t exitPc, const unsigned tCycles ) {
+        addExit( emitter.jcc( cond ), exitPc, tCycles );
+    }
+    void exitTo( const uint16_t exitPc, const unsigned tCycles ) {
+        addExit( emitter.jmp(), exitPc, tCycles );
+    }
+
+    static Reg pairRegister( const uint8_t index ) {
+        constexpr Reg pairs[] = { regBC, regDE, regHL, regSP };
+        return pairs[index];
+    }
+
+    // r8 encoding from opcode, 6 ( (HL) ) is handled by callers
+    void get8( const uint8_t code, const Reg dst ) {
+        if( code == 7 ) {
+            emitter.mov( dst, regA );
+            return;
+        }
+        const Reg pair = pairRegister( code / 2 );
+        if( code % 2 == 0 ) {
+            emitter.mov( dst, pair );
+            emitter.shift( Shift::shr, dst, 8 );
+        } else
+            emitter.movzx8( dst, pair );
+    }
+    // Clobbers src
+    void set8( const uint8_t code, const Reg src ) {
+        if( code == 7 ) {
+            emitter.mov( regA, src );
+            return;
+        }
+        const Reg pair = pairRegister( code / 2 );
+        if( code % 2 == 0 ) {
+            emitter.aluImm( Alu::and_, pair, 0xFF );
+            emitter.shift( Shift::shl, src, 8 );
+        } else
+            emitter.aluImm( Alu::and_, pair, 0xFF00 );
+        emitter.alu( Alu::or_, pair, src );
+    }
+    void wrap16( const Reg reg ) {
+        emitter.movzx16( reg, reg );
+    }
+
+    // Helpers take the address in esi and value in edx, result is in eax
+    void callHelper( const uint64_t helper ) {
+        emitter.loadCpuPointer();
+        emitter.call( helper );
+    }
+    void read() {
+        callHelper( context.readHelper );
+        emitter.aluImm( Alu::cmp, rax, 0xFF );
+        exitIf( Cond::above, pc, tCyclesBefore );
+    }
+    void read16() {
+        callHelper( context.read16Helper );
+        emitter.aluImm( Alu::cmp, rax, 0xFFFF );
+        exitIf( Cond::above, pc, tCyclesBefore );
+    }
+    // Rest of the instruction has to keep eax and be followed by leaveIfCodeChanged()
+    void write() {
+        callHelper( context.writeHelper );
+        emitter.aluImm( Alu::cmp, rax, 1 );
+        exitIf( Cond::above, pc, tCyclesBefore );
+    }
+    void write16() {
+        callHelper( context.write16Helper );
+        emitter.aluImm( Alu::cmp, rax, 1 );
+        exitIf( Cond::above, pc, tCyclesBefore );
+    }
+    void leaveIfCodeChanged( const unsigned tCycles ) {
+        emitter.aluImm( Alu::cmp, rax, 1 );
+        exitIf( Cond::equal, nextPc, tCyclesBefore + tCycles );
+    }
+    void stackAddress( const int delta ) {
+        emitter.mov( rsi, regSP );
+        emitter.aluImm( delta < 0 ? Alu::sub : Alu::add, rsi, static_cast<uint32_t>( delta < 0 ? -delta : delta ) );
+        wrap16( rsi );
+    }
+    void adjustSP( const int delta ) {
+        emitter.aluImm( delta < 0 ? Alu::sub : Alu::add, regSP, static_cast<uint32_t>( delta < 0 ? -delta : delta ) );
+        wrap16( regSP );
+    }
+
+    // F from the x86 flags of a byte operation saved by lahf, N is constant
+    void flagsFromAH( const bool subtraction ) {
+        emitter.movzxAH( rdx );
+        emitter.mov( regF, rdx );
+        emitter.aluImm( Alu::and_, regF, 0x50 ); // ZF, AF
+        emitter.shift( Shift::shl, regF, 1 );     // Z, H
+        emitter.aluImm( Alu::and_, rdx, 0x01 );  // CF
+        emitter.shift( Shift::shl, rdx, 4 );
+        emitter.alu( Alu::or_, regF, rdx );
+        if( subtraction )
+            emitter.aluImm( Alu::or_, regF, 0x40 );
+    }
+    // F = Z of reg | other, other is in edx or an immediate
+    void zeroFlag( const Reg reg, const uint32_t otherFlags, const bool otherInEdx = false ) {
+        emitter.test( reg, reg );
+        emitter.setcc( Cond::equal, rax );
+        emitter.movzx8( rax, rax );
+        emitter.shift( Shift::shl, rax, 7 );
+        if( otherInEdx )
+            emitter.alu( Alu::or_, rax, rdx );
+        if( otherFlags )
+            emitter.aluImm( Alu::or_, rax, otherFlags );
+        emitter.mov( regF, rax );
+    }
+
+    // ALU operation from opcode on A and ecx
+    void aluA( const uint8_t operation ) {
+        switch( operation ) {
+        case 4:
+            emitter.alu( Alu::and_, regA, rcx );
+            zeroFlag( regA, 0x20 );
+            return;
+        case 5:
+            emitter.alu( Alu::xor_, regA, rcx );
+            zeroFlag( regA, 0 );
+            return;
+        case 6:
+            emitter.alu( Alu::or_, regA, rcx );
+            zeroFlag( regA, 0 );
+            return;
+        default:
+            break;
+        }
+        constexpr Alu x86Operations[] = { Alu::add, Alu::adc, Alu::sub, Alu::sbb, {}, {}, {}, Alu::cmp };
+        emitter.mov( rax, regA );
+        if( operation == 1 || operation == 3 )
+            emitter.bt( regF, 4 );
+        emitter.alu8( x86Operations[operation], rax, rcx );
+        emitter.lahf();
+        if( operation != 7 )
+            emitter.movzx8( regA, rax );
+        flagsFromAH( operation >= 2 );
+    }
+
+    // Rotates and shifts from CB opcode on ecx, leaves the new carry in edx
+    void shiftEcx( const uint8_t operation ) {
+        switch( operation ) {
+        case 0: // RLC
+            emitter.mov( rdx, rcx );
+            emitter.shift( Shift::shr, rdx, 7 );
+            emitter.shift( Shift::shl, rcx, 1 );
+            emitter.alu( Alu::or_, rcx, rdx );
+            emitter.aluImm( Alu::and_, rcx, 0xFF );
+            break;
+        case 1: // RRC
+            emitter.mov( rdx, rcx );
+            emitter.aluImm( Alu::and_, rdx, 1 );
+            emitter.shift( Shift::shr, rcx, 1 );
+            emitter.mov( rsi, rdx );
+            emitter.shift( Shift::shl, rsi, 7 );
+            emitter.alu( Alu::or_, rcx, rsi );
+            break;
+        case 2: // RL
+            emitter.mov( rsi, regF );
+            emitter.shift( Shift::shr, rsi, 4 );
+            emitter.aluImm( Alu::and_, rsi, 1 );
+            emitter.mov( rdx, rcx );
+            emitter.shift( Shift::shr, rdx, 7 );
+            emitter.shift( Shift::shl, rcx, 1 );
+            emitter.alu( Alu::or_, rcx, rsi );
+            emitter.aluImm( Alu::and_, rcx, 0xFF );
+            break;
+        case 3: // RR
+            emitter.mov( rsi, regF );
+            emitter.aluImm( Alu::and_, rsi, 0x10 );
+            emitter.shift( Shift::shl, rsi, 3 );
+            emitter.mov( rdx, rcx );
+            emitter.aluImm( Alu::and_, rdx, 1 );
+            emitter.shift( Shift::shr, rcx, 1 );
+            emitter.alu( Alu::or_, rcx, rsi );
+            break;
+        case 4: // SLA
+            emitter.mov( rdx, rcx );
+            emitter.shift( Shift::shr, rdx, 7 );
+            emitter.shift( Shift::shl, rcx, 1 );
+            emitter.aluImm( Alu::and_, rcx, 0xFF );
+            break;
+        case 5: // SRA
+            emitter.mov( rdx, rcx );
+            emitter.aluImm( Alu::and_, rdx, 1 );
+            emitter.mov( rsi, rcx );
+            emitter.aluImm( Alu::and_, rsi, 0x80 );
+            emitter.shift( Shift::shr, rcx, 1 );
+            emitter.alu( Alu::or_, rcx, rsi );
+            break;
+        case 6: // SWAP
+            emitter.mov( rsi, rcx );
+            emitter.shift( Shift::shl, rsi, 4 );
+            emitter.shift( Shift::shr, rcx, 4 );
+            emitter.alu( Alu::or_, rcx, rsi );
+            emitter.aluImm( Alu::and_, rcx, 0xFF );
+            emitter.alu( Alu::xor_, rdx, rdx );
+            break;
+        case 7: // SRL
+            emitter.mov( rdx, rcx );
+            emitter.aluImm( Alu::and_, rdx, 1 );
+            emitter.shift( Shift::shr, rcx, 1 );
+            break;
+        default:
+            std::unreachable();
+        }
+    }
+
+    void incDec8( const uint8_t code, const bool decrement ) {
+        get8( code, rax );
+        if( decrement )
+            emitter.dec8( rax );
+        else
+            emitter.inc8( rax );
+        emitter.lahf();
+        emitter.movzx8( rcx, rax );
+        emitter.movzxAH( rdx );
+        emitter.aluImm( Alu::and_, rdx, 0x50 );
+        emitter.shift( Shift::shl, rdx, 1 );
+        emitter.aluImm( Alu::and_, regF, 0x10 ); // C is kept
+        emitter.alu( Alu::or_, regF, rdx );
+        if( decrement )
+            emitter.aluImm( Alu::or_, regF, 0x40 );
+        set8( code, rcx );
+    }
+
+    void addToHL( const Reg value ) {
+        emitter.mov( rcx, value );
+        emitter.mov( rdx, regHL );
+        emitter.aluImm( Alu::and_, rdx, 0xFFF );
+        emitter.mov( rsi, rcx );
+        emitter.aluImm( Alu::and_, rsi, 0xFFF );
+        emitter.alu( Alu::add, rdx, rsi );
+        emitter.shift( Shift::shr, rdx, 12 );
+        emitter.shift( Shift::shl, rdx, 5 ); // H
+        emitter.mov( rax, regHL );
+        emitter.alu( Alu::add, rax, rcx );
+        emitter.mov( rsi, rax );
+        emitter.shift( Shift::shr, rsi, 16 );
+        emitter.shift( Shift::shl, rsi, 4 ); // C
+        emitter.movzx16( regHL, rax );
+        emitter.aluImm( Alu::and_, regF, 0x80 );
+        emitter.alu( Alu::or_, regF, rdx );
+        emitter.alu( Alu::or_, regF, rsi );
+    }
+
+    // Conditional control flow, condition code from opcode bits 3-4: NZ, Z, NC, C
+    void exitIfCondition( const uint8_t opcode, const uint16_t target ) {
+        const uint8_t condition = ( opcode >> 3 ) & 3;
+        emitter.testImm( regF, condition < 2 ? 0x80 : 0x10 );
+        exitIf( condition & 1 ? Cond::notEqual : Cond::equal, target,
+                tCyclesBefore + cycles::opcodeCyclesBranched[opcode] );
+        exitTo( nextPc, tCyclesBefore + cycles::opcodeCycles[opcode] );
+    }
+
+    bool translateCB( const uint8_t opcode ) {
+        const uint8_t code = opcode & 7;
+        const uint8_t bit  = ( opcode >> 3 ) & 7;
+        if( code == 6 )
+            return false;
+        get8( code, rcx );
+        switch( opcode >> 6 ) {
+        case 0:
+            shiftEcx( bit );
+            emitter.shift( Shift::shl, rdx, 4 );
+            zeroFlag( rcx, 0, true );
+            break;
+        case 1: // BIT
+            emitter.testImm( rcx, 1u << bit );
+            emitter.setcc( Cond::equal, rax );
+            emitter.movzx8( rax, rax );
+            emitter.shift( Shift::shl, rax, 7 );
+            emitter.aluImm( Alu::and_, regF, 0x10 );
+            emitter.aluImm( Alu::or_, regF, 0x20 );
+            emitter.alu( Alu::or_, regF, rax );
+            return true;
+        case 2: // RES
+            emitter.aluImm( Alu::and_, rcx, ~( 1u << bit ) & 0xFF );
+            break;
+        case 3: // SET
+            emitter.aluImm( Alu::or_, rcx, 1u << bit );
+            break;
+        default:
+            std::unreachable();
+        }
+        set8( code, rcx );
+        return true;
+    }
+
+public:
+    bool ended = false; // control flow left the block
+
+    // Returns false without emitting anything if the instruction has no translation
+    bool translate( const CachedCpu::CachedInstruction& instruction, const uint16_t length ) {
+        pc                  = instruction.address;
+        nextPc              = static_cast<uint16_t>( pc + length );
+        const uint8_t n     = instruction.operands[0];
+        const uint16_t nn   = static_cast<uint16_t>( instruction.operands[0] | instruction.operands[1] << 8 );
+        const uint16_t op16 = instruction.opcode;
+        const auto opcode   = static_cast<uint8_t>( op16 );
+
+        if( op16 > 0xFF ) {
+            if( ! translateCB( opcode ) )
+                return false;
+            tCyclesBefore += cycles::opcodeCyclesCb[opcode];
+            return true;
+        }
+
+        const uint8_t x = opcode >> 6;
+        const uint8_t y = ( opcode >> 3 ) & 7;
+        const uint8_t z = opcode & 7;
+        const Reg pair  = pairRegister( y >> 1 );
+        const auto relativeTarget =
+                static_cast<uint16_t>( nextPc + static_cast<int8_t>( n ) ); // only valid for JR
+        unsigned tCycles = cycles::opcodeCycles[opcode];
+
+        if( x == 1 ) {
+            if( opcode == 0x76 ) // HALT
+                return false;
+            if( z == 6 ) { // LD r, (HL)
+                emitter.mov( rsi, regHL );
+                read();
+                set8( y, rax );
+            } else if( y == 6 ) { // LD (HL), r
+                get8( z, rdx );
+                emitter.mov( rsi, regHL );
+                write();
+                leaveIfCodeChanged( tCycles );
+            } else {
+                get8( z, rcx );
+                set8( y, rcx );
+            }
+            tCyclesBefore += tCycles;
+            return true;
+        }
+        if( x == 2 || ( x == 3 && z == 6 ) ) { // ALU A, r / ALU A, imm8
+            if( x == 3 )
+                emitter.movImm( rcx, n );
+            else if( z == 6 ) {
+                emitter.mov( rsi, regHL );
+                read();
+                emitter.mov( rcx, rax );
+            } else
+                get8( z, rcx );
+            aluA( y );
+            tCyclesBefore += tCycles;
+            return true;
+        }
+
+        switch( opcode ) {
+        case 0x00: // NOP
+            break;
+        case 0x01:
+        case 0x11:
+        case 0x21:
+        case 0x31: // LD r16, imm16
+            emitter.movImm( pair, nn );
+            break;
+        case 0x02:
+        case 0x12:
+        case 0x22:
+        case 0x32: // LD (r16mem), A
+            emitter.mov( rsi, y < 4 ? pair : regHL );
+            emitter.mov( rdx, regA );
+            write();
+            if( y >= 4 ) {
+                emitter.aluImm( y == 4 ? Alu::add : Alu::sub, regHL, 1 );
+                wrap16( regHL );
+            }
+            leaveIfCodeChanged( tCycles );
+            break;
+        case 0x0A:
+        case 0x1A:
+        case 0x2A:
+        case 0x3A: // LD A, (r16mem)
+            emitter.mov( rsi, y < 4 ? pair : regHL );
+            read();
+            emitter.mov( regA, rax );
+            if( y >= 4 ) {
+                emitter.aluImm( y == 5 ? Alu::add : Alu::sub, regHL, 1 );
+                wrap16( regHL );
+            }
+            break;
+        case 0x03:
+        case 0x13:
+        case 0x23:
+        case 0x33: // INC r16
+            emitter.aluImm( Alu::add, pair, 1 );
+            wrap16( pair );
+            break;
+        case 0x0B:
+        case 0x1B:
+        case 0x2B:
+        case 0x3B: // DEC r16
+            emitter.aluImm( Alu::sub, pair, 1 );
+            wrap16( pair );
+            break;
+        case 0x09:
+        case 0x19:
+        case 0x29:
+        case 0x39: // ADD HL, r16
+            addToHL( pair );
+            break;
+        case 0x07: // RLCA
+        case 0x0F: // RRCA
+        case 0x17: // RLA
+        case 0x1F: // RRA
+            emitter.mov( rcx, regA );
+            shiftEcx( y );
+            emitter.mov( regA, rcx );
+            emitter.mov( regF, rdx );
+            emitter.shift( Shift::shl, regF, 4 );
+            break;
+        case 0x2F: // CPL
+            emitter.aluImm( Alu::xor_, regA, 0xFF );
+            emitter.aluImm( Alu::or_, regF, 0x60 );
+            break;
+        case 0x37: // SCF
+            emitter.aluImm( Alu::and_, regF, 0x80 );
+            emitter.aluImm( Alu::or_, regF, 0x10 );
+            break;
+        case 0x3F: // CCF
+            emitter.aluImm( Alu::and_, regF, 0x90 );
+            emitter.aluImm( Alu::xor_, regF, 0x10 );
+            break;
+        case 0x18: // JR
+            exitTo( relativeTarget, tCyclesBefore + cycles::opcodeCyclesBranched[opcode] );
+            ended = true;
+            break;
+        case 0x20:
+        case 0x28:
+        case 0x30:
+        case 0x38: // JR cond
+            exitIfCondition( opcode, relativeTarget );
+            ended = true;
+            break;
+        case 0xC3: // JP
+            exitTo( nn, tCyclesBefore + tCycles );
+            ended = true;
+            break;
+        case 0xC2:
+        case 0xCA:
+        case 0xD2:
+        case 0xDA: // JP cond
+            exitIfCondition( opcode, nn );
+            ended = true;
+            break;
+        case 0xE9: // JP HL
+            emitter.mov( rcx, regHL );
+            addExit( emitter.jmp(), 0, tCyclesBefore + tCycles, true );
+            ended = true;
+            break;
+        case 0xCD: // CALL
+            stackAddress( -2 );
+            emitter.movImm( rdx, nextPc );
+            write16();
+            adjustSP( -2 );
+            exitTo( nn, tCyclesBefore + tCycles );
+            ended = true;
+            break;
+        case 0xC9: // RET
+            emitter.mov( rsi, regSP );
+            read16();
+            adjustSP( 2 );
+            emitter.mov( rcx, rax );
+            addExit( emitter.jmp(), 0, tCyclesBefore + tCycles, true );
+            ended = true;
+            break;
+        case 0xC1:
+        case 0xD1:
+        case 0xE1:
+        case 0xF1: // POP
+            emitter.mov( rsi, regSP );
+            read16();
+            adjustSP( 2 );
+            if( opcode == 0xF1 ) {
+                emitter.mov( regA, rax );
+                emitter.shift( Shift::shr, regA, 8 );
+                emitter.aluImm( Alu::and_, rax, 0xF0 );
+                emitter.mov( regF, rax );
+            } else
+                emitter.mov( pairRegister( ( opcode >> 4 ) & 3 ), rax );
+            break;
+        case 0xC5:
+        case 0xD5:
+        case 0xE5:
+        case 0xF5: // PUSH
+            if( opcode == 0xF5 ) {
+                emitter.mov( rdx, regA );
+                emitter.shift( Shift::shl, rdx, 8 );
+                emitter.alu( Alu::or_, rdx, regF );
+            } else
+                emitter.mov( rdx, pairRegister( ( opcode >> 4 ) & 3 ) );
+            stackAddress( -2 );
+            write16();
+            adjustSP( -2 );
+            leaveIfCodeChanged( tCycles );
+            break;
+        case 0xE0: // LDH (imm8), A
+        case 0xE2: // LDH (C), A
+        case 0xEA: // LD (imm16), A
+            if( opcode == 0xE2 ) {
+                emitter.movzx8( rsi, regBC );
+                emitter.aluImm( Alu::or_, rsi, addr::ioRegisters );
+            } else
+                emitter.movImm( rsi, opcode == 0xEA ? nn : addr::ioRegisters + n );
+            emitter.mov( rdx, regA );
+            write();
+            leaveIfCodeChanged( tCycles );
+            break;
+        case 0xF0: // LDH A, (imm8)
+        case 0xF2: // LDH A, (C)
+        case 0xFA: // LD A, (imm16)
+            if( opcode == 0xF2 ) {
+                emitter.movzx8( rsi, regBC );
+                emitter.aluImm( Alu::or_, rsi, addr::ioRegisters );
+            } else
+                emitter.movImm( rsi, opcode == 0xFA ? nn : addr::ioRegisters + n );
+            read();
+            emitter.mov( regA, rax );
+            break;
+        default:
+            if( x == 0 && ( z == 4 || z == 5 ) && y != 6 ) { // INC r8, DEC r8
+                incDec8( y, z == 5 );
+                break;
+            }
+            if( x == 0 && z == 6 ) { // LD r8, imm8
+                if( y == 6 ) {
+                    emitter.mov( rsi, regHL );
+                    emitter.movImm( rdx, n );
+                    write();
+                    leaveIfCodeChanged( tCycles );
+                } else {
+                    emitter.movImm( rcx, n );
+                    set8( y, rcx );
+                }
+                break;
+            }
+            return false;
+        }
+        tCyclesBefore += tCycles;
+        return true;
+    }
+
+    // Continues by interpreting from resumePc after the translated instructions
+    void exitAfterTranslated( const uint16_t resumePc ) {
+        exitTo( resumePc, tCyclesBefore );
+    }
+    // T-cycles of the longest path through the translated instructions
+    unsigned maxCycles() const {
+        return longestExit;
+    }
+
+    // Prologue loads registers, every exit stores PC, returns its T-cycles and jumps to the epilogue
+    std::vector<uint8_t> finish() {
+        Emitter result;
+        result.push( rbx );
+        result.push( rbp );
+        result.push( r12 );
+        result.push( r13 );
+        result.push( r14 );
+        result.push( r15 );
+        result.adjustStack( true );
+        result.storeCpuPointer();
+        const uint32_t registers = context.registersOffset;
+        result.loadCpu8( regA, context.aOffset );
+        result.loadCpu8( regF, context.fOffset );
+        for( uint8_t i = 0; i < 3; i++ )
+            result.loadCpu16( pairRegister( i ), registers + 2 * i );
+        result.loadCpu16( regSP, context.spOffset );
+
+        const std::size_t bodyStart = result.code.size();
+        result.code.insert( result.code.end(), emitter.code.begin(), emitter.code.end() );
+
+        std::vector<std::size_t> toEpilogue;
+        for( const auto& exit: exits ) {
+            result.patch( bodyStart + exit.jumpPosition, result.code.size() );
+            result.loadCpuPointer();
+            if( exit.pcInEcx )
+                result.storeCpu16( context.pcOffset, rcx );
+            else
+                result.storeCpuImm16( context.pcOffset, exit.pc );
+            result.movImm( rax, exit.tCycles );
+            toEpilogue.push_back( result.jmp() );
+        }
+        for( const auto position: toEpilogue )
+            result.patch( position, result.code.size() );
+
+        result.loadCpuPointer();
+        result.storeCpu8( context.aOffset, regA );
+        result.storeCpu8( context.fOffset, regF );
+        for( uint8_t i = 0; i < 3; i++ )
+            result.storeCpu16( registers + 2 * i, pairRegister( i ) );
+        result.storeCpu16( context.spOffset, regSP );
+        result.adjustStack( false );
+        result.pop( r15 );
+        result.pop( r14 );
+        result.pop( r13 );
+        result.pop( r12 );
+        result.pop( rbp );
+        result.pop( rbx );
+        result.ret();
+        return std::move( result.code );
+    }
+
+    BlockCompiler( const CompilerContext& context_ ) : context( context_ ) {
+    }
+};
+} // namespace
+
+//--------------------------------------------------
+uint32_t JitCpu::readHelper( JitCpu* cpu, uint32_t address ) {
+    if( ! isDirectlyAccessible( address ) )
+        return 0x100;
+    return cpu->bus.read( static_cast<uint16_t>( address ) );
+}
+
+uint32_t JitCpu::read16Helper( JitCpu* cpu, uint32_t address ) {
+    const auto high = static_cast<uint16_t>( address + 1 );
+    if( ! isDirectlyAccessible( address ) || ! isDirectlyAccessible( high ) )
+        return 0x10000;
+    return static_cast<uint32_t>( cpu->bus.read( static_cast<uint16_t>( address ) ) | cpu->bus.read( high ) << 8 );
+}
+
+uint32_t JitCpu::writeHelper( JitCpu* cpu, uint32_t address, uint32_t value ) {
+    if( ! isDirectlyAccessible( address ) )
+        return 2;
+    const unsigned invalidationsBefore = cpu->invalidations;
+    cpu->bus.write( static_cast<uint16_t>( address ), static_cast<uint8_t>( value ) );
+    return cpu->invalidations != invalidationsBefore;
+}
+
+// Writes the high byte first, like PUSH
+uint32_t JitCpu::write16Helper( JitCpu* cpu, uint32_t address, uint32_t value ) {
+    const auto high = static_cast<uint16_t>( address + 1 );
+    if( ! isDirectlyAccessible( address ) || ! isDirectlyAccessible( high ) )
+        return 2;
+    const unsigned invalidationsBefore = cpu->invalidations;
+    cpu->bus.write( high, static_cast<uint8_t>( value >> 8 ) );
+    cpu->bus.write( static_cast<uint16_t>( address ), static_cast<uint8_t>( value ) );
+    return cpu->invalidations != invalidationsBefore;
+}
+
+//--------------------------------------------------
+bool JitCpu::compileBlock( Block& block ) {
+    const CompilerContext context {
+            .registersOffset = registersOffset,
+            .aOffset         = registersOffset + aIndex,
+            .fOffset         = registersOffset + fIndex,
+            .spOffset        = spOffset,
+            .pcOffset        = pcOffset,
+            .readHelper      = reinterpret_cast<uint64_t>( &readHelper ),
+            .read16Helper    = reinterpret_cast<uint64_t>( &read16Helper ),
+            .writeHelper     = reinterpret_cast<uint64_t>( &writeHelper ),
+            .write16Helper   = reinterpret_cast<uint64_t>( &write16Helper ),
+    };
+    BlockCompiler compiler( context );
+
+    unsigned translated = 0;
+    uint16_t resumePc   = 0;
+    for( const auto& instruction: block.instructions ) {
+        if( translated == maxCompiledLength )
+            break;
+        const uint8_t operandCount =
+                instruction.opcode > 0xFF ? 0 : operandLength( static_cast<uint8_t>( instruction.opcode ) );
+        const auto length = static_cast<uint16_t>( instruction.opcodeLength + operandCount );
+        if( ! compiler.translate( instruction, length ) )
+            break;
+        translated++;
+        resumePc = static_cast<uint16_t>( instruction.address + length );
+        if( compiler.ended )
+            break;
+    }
+    if( translated == 0 )
+        return false;
+    if( ! compiler.ended )
+        compiler.exitAfterTranslated( resumePc );
+
+    const auto code = compiler.finish();
+    if( code.size() > maxCompiledBlockSize ) {
+        logError( ErrorCode::JitCompilationError,
+                  std::format( "Compiled block at {} is too large", toHex( block.instructions.front().address ) ) );
+        return false;
+    }
+    const std::size_t codeEnd = codeLength + code.size();
+    if( ! protectPages( codeBuffer, codeLength, codeEnd, PROT_READ | PROT_WRITE ) ) {
+        logError( ErrorCode::JitCompilationError, "Can't make the code buffer writable" );
+        return false;
+    }
+    std::memcpy( codeBuffer + codeLength, code.data(), code.size() );
+    // Also the tail of the previous block when it shares the first page
+    if( ! protectPages( codeBuffer, codeLength, codeEnd, PROT_READ | PROT_EXEC ) ) {
+        logError( ErrorCode::JitCompilationError, "Can't make the code buffer executable" );
+        return false;
+    }
+    block.compiled       = codeBuffer + codeLength;
+    block.compiledCycles = compiler.maxCycles();
+    codeLength += ( code.size() + 15 ) & ~std::size_t { 15 };
+    logDebug( std::format( "Compiled {} instructions at {} to {} bytes", translated,
+                           toHex( block.instructions.front().address ), code.size() ) );
+    return true;
+}
+
+unsigned JitCpu::runCompiled( const Block& block ) {
+    materializeFlags(); // compiled code keeps F in a host register
+    const unsigned tCycles = std::bit_cast<Compiled_t>( block.compiled )( this );
+    if( tCycles )
+        cursor = blockEnd = nullptr;
+    return tCycles;
+}
+
+void JitCpu::flushBlocks() {
+    CachedCpu::flushBlocks();
+    codeLength = 0;
+}
+
+JitCpu::JitCpu( IBus& bus_ ) : CachedCpu( bus_ ) {
+    const auto offsetOf = [this]( const void* member ) {
+        return static_cast<uint32_t>( static_cast<const uint8_t*>( member ) -
+                                      reinterpret_cast<const uint8_t*>( this ) );
+    };
+    registersOffset = offsetOf( registers );
+    spOffset        = offsetOf( &SP );
+    pcOffset        = offsetOf( &PC );
+
+    void* buffer = mmap( nullptr, codeBufferSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if( buffer == MAP_FAILED ) {
+        logError( ErrorCode::JitCompilationError, "Can't allocate the code buffer, blocks won't be compiled" );
+        return;
+    }
+    codeBuffer = static_cast<uint8_t*>( buffer );
+}
+
+JitCpu::~JitCpu() {
+    if( codeBuffer )
+        munmap( codeBuffer, codeBufferSize );
+}
+
+//--------------------------------------------------
+unsigned JitCpu::tick() {
+    if( const unsigned tCycles = serviceInterrupts() )
+        return tCycles;
+
+    if( cursor == blockEnd || cursor->address != PC ) [[unlikely]] {
+        Block* block = enterBlock( PC );
+        if( ! block )
+            return executeInstruction();
+        if( ! block->compiled && ++block->executions == hotThreshold && codeBuffer ) {
+            if( codeBufferSize - codeLength < maxCompiledBlockSize ) {
+                flushBlocks(); // drops block too
+                return executeInstruction();
+            }
+            compileBlock( *block );
+        }
+        // Compiled code checks no interrupt, so it runs only when none can be dispatched before its end.
+        // A pending EI takes effect after the first instruction, which is left to the interpreter too.
+        if( block->compiled && ! enableIMELater && interruptFreeFor( block->compiledCycles ) ) {
+            if( const unsigned tCycles = runCompiled( *block ) )
+                return tCycles;
+            // Compiled code left before its first instruction, interpreter has to execute it
+        }
+    }
+    return executeCachedInstruction();
+}
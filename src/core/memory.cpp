@@ -1,65 +1,124 @@
 #include "core/memory.hpp"
 #include <cstdint>
+#include <cstring>
+#include <span>
 
-uint8_t Memory::read( const uint16_t index ) const {
-    if( inRom( index ) or inExternalRam( index ) ) [[likely]]
+void Memory::mapPage( const unsigned page, const uint8_t* readData, uint8_t* writeData,
+                      const Handler_t handler ) {
+    readPages[page]     = readData;
+    writePages[page]    = writeData;
+    handlers[page]      = handler;
+    const bool isLocked = ( vramLocked && page >= addr::videoRam >> 8 && page < addr::externalRam >> 8 ) ||
+                          ( oamLocked && page == addr::objectAttributeMemory >> 8 ) ||
+                          ( dmaLocked && page < addr::ioRegisters >> 8 );
+    busReadPages[page]  = isLocked ? nullptr : readData;
+    busWritePages[page] = isLocked ? nullptr : writeData;
+    mapVersion++;
+}
+
+void Memory::mapCartridge() {
+    using enum CoreCartridge::Region_t;
+    // ROM is read only, writes select banks
+    for( const auto region : { ROM_00, ROM_0N } ) {
+        const uint8_t* bank = cartridge->mappedBank( region );
+        const unsigned base = region == ROM_00 ? addr::rom00 >> 8 : addr::rom0N >> 8;
+        for( unsigned i = 0; i < 0x40; i++ )
+            mapPage( base + i, bank ? bank + i * 0x100 : nullptr, nullptr, Handler_t::CARTRIDGE );
+    }
+    uint8_t* ram = cartridge->mappedBank( EXTERNAL_RAM );
+    for( unsigned i = 0; i < 0x20; i++ ) {
+        uint8_t* data = ram ? ram + i * 0x100 : nullptr;
+        mapPage( ( addr::externalRam >> 8 ) + i, data, data, Handler_t::CARTRIDGE );
+    }
+}
+
+uint8_t Memory::readSlow( const uint16_t index ) const {
+    if( handlers[index >> 8] == Handler_t::CARTRIDGE )
         return cartridge->read( index );
+    return 0;
+}
+
+std::span<uint8_t> Memory::ramSpan( const uint16_t index ) {
     if( inVideoRam( index ) )
-        return videoRam[index - addr::videoRam];
+        return std::span( videoRam ).subspan( index - addr::videoRam );
     if( inWorkRam00( index ) )
-        return workRam00[index - addr::workRam00];
+        return std::span( workRam00 ).subspan( index - addr::workRam00 );
     if( inWorkRam0N( index ) )
-        return workRam0N[index - addr::workRam0N];
+        return std::span( workRam0N ).subspan( index - addr::workRam0N );
     if( inEchoRam00( index ) )
-        return workRam00[index - addr::echoRam00];
+        return std::span( workRam00 ).subspan( index - addr::echoRam00 );
     if( inEchoRam0N( index ) ) //echo RAM 0N is smaller than work RAM 0N
-        return workRam0N[index - addr::echoRam0N];
-    if( inObjectAttributeMemory( index ) )
-        return oam[index - addr::objectAttributeMemory];
-    // todo else if (index < NOT_USABLE + X)
-    if( inIoRegisters( index ) )
-        return ioRegisters[index - addr::ioRegisters];
+        return std::span( workRam0N ).subspan( index - addr::echoRam0N, addr::objectAttributeMemory - index );
     if( inHighRam( index ) )
-        return highRam[index - addr::highRam];
-    if( index == addr::interruptEnableRegister )
-        return interruptEnableRegister;
-    return 0;
+        return std::span( highPage ).subspan( index - addr::ioRegisters,
+                                              addr::interruptEnableRegister - index );
+    return {};
 }
 
-void Memory::write( const uint16_t index, uint8_t value ) {
-    if( inRom( index ) or inExternalRam( index ) )
+void Memory::writeSlow( const uint16_t index, uint8_t value ) {
+    switch( handlers[index >> 8] ) {
+        using enum Handler_t;
+    case CARTRIDGE:
         cartridge->write( index, value );
-    else if( inVideoRam( index ) )
-        videoRam[index - addr::videoRam] = value;
-    else if( inWorkRam00( index ) )
-        workRam00[index - addr::workRam00] = value;
-    else if( inWorkRam0N( index ) )
-        workRam0N[index - addr::workRam0N] = value;
-    else if( inEchoRam00( index ) )
-        workRam00[index - addr::echoRam00] = value;
-    else if( inEchoRam0N( index ) ) //echo RAM 0N is smaller than work RAM 0N
-        workRam0N[index - addr::echoRam0N] = value;
-    else if( inObjectAttributeMemory( index ) )
-        oam[index - addr::objectAttributeMemory] = value;
-    // TODO else if (index < NOT_USABLE + X)
-    else if( inIoRegisters( index ) ) {
-        ioRegisters[index - addr::ioRegisters] = value;
-        // side effects
-        if( index == addr::lcdY ) {
-            if( value == read( addr::lyc ) ) {
-                ioRegisters[addr::lcdStatus - addr::ioRegisters] |= ( 1 << 2 );
-                //TODO interrupt
-            } else
-                ioRegisters[addr::lcdStatus - addr::ioRegisters] &= ~( 1 << 2 );
-        }
-    } else if( inHighRam( index ) )
-        highRam[index - addr::highRam] = value;
-    else if( index == addr::interruptEnableRegister )
-        interruptEnableRegister = value;
+        break;
+    case OBJECT_ATTRIBUTE_MEMORY:
+        if( inObjectAttributeMemory( index ) )
+            oam[index - addr::objectAttributeMemory] = value;
+        break;
+    case DIRECT:
+        break;
+    }
+}
+
+void Memory::setVramLock( const bool locked_ ) {
+    vramLocked = locked_;
+    for( unsigned page = addr::videoRam >> 8; page < addr::externalRam >> 8; page++ )
+        mapPage( page, readPages[page], writePages[page], handlers[page] );
 }
 
+void Memory::setOamLock( const bool locked_ ) {
+    oamLocked           = locked_;
+    const unsigned page = addr::objectAttributeMemory >> 8;
+    mapPage( page, readPages[page], writePages[page], handlers[page] );
+}
+
+void Memory::oamDma( const uint16_t source ) {
+    // The transfer never crosses a page
+    if( const uint8_t* page = readPages[source >> 8] ) [[likely]]
+        std::memcpy( oam, page + ( source & 0xFF ), size::oam );
+    else
+        for( uint16_t i = 0; i < size::oam; i++ )
+            oam[i] = readSlow( static_cast<uint16_t>( source + i ) );
+}
+
+void Memory::setDmaLock( const bool locked_ ) {
+    dmaLocked = locked_;
+    for( unsigned page = 0; page < addr::ioRegisters >> 8; page++ )
+        mapPage( page, readPages[page], writePages[page], handlers[page] );
+}
 
 Memory::Memory( CoreCartridge* cartridge_ ) : cartridge( cartridge_ ) {
+    using enum Handler_t;
+    for( unsigned page = 0; page < 0x100; page++ ) {
+        const uint16_t index = static_cast<uint16_t>( page << 8 );
+        if( inVideoRam( index ) )
+            mapPage( page, &videoRam[index - addr::videoRam], &videoRam[index - addr::videoRam], DIRECT );
+        else if( inWorkRam00( index ) || inEchoRam00( index ) ) {
+            uint8_t* data = &workRam00[( index - addr::workRam00 ) & 0xFFF];
+            mapPage( page, data, data, DIRECT );
+        } else if( inWorkRam0N( index ) || inEchoRam0N( index ) ) {
+            uint8_t* data = &workRam0N[( index - addr::workRam0N ) & 0xFFF];
+            mapPage( page, data, data, DIRECT );
+        } else if( inObjectAttributeMemory( index ) )
+            mapPage( page, oam, nullptr, OBJECT_ATTRIBUTE_MEMORY );
+        else if( inIoRegisters( index ) )
+            mapPage( page, highPage, highPage, DIRECT );
+        else // ROM and external RAM pages are mapped below
+            mapPage( page, nullptr, nullptr, CARTRIDGE );
+    }
+    mapCartridge();
+    cartridge->setBankListener( [this] { mapCartridge(); } );
+
     // DMG
     write( 0xFF00, 0xCF ); // P1
     write( 0xFF01, 0x00 ); // SB
@@ -104,3 +163,7 @@ Memory::Memory( CoreCartridge* cartridge_ ) : cartridge( cartridge_ ) {
     write( 0xFF4B, 0x00 ); // WX
     write( 0xFFFF, 0x00 ); // INTERRUPT ENABLE
 }
+
+Memory::~Memory() {
+    cartridge->setBankListener( nullptr );
+}
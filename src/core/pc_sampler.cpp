@@ -0,0 +1,168 @@
+#include "core/pc_sampler.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <iterator>
+#include <map>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+namespace {
+PcSampler::Location locationOf( const IBus& bus, const uint16_t address ) {
+    const bool switchable = 0x4000 <= address && address < 0x8000;
+    return { static_cast<uint16_t>( switchable ? bus.mappedRomBank( address ) : 0 ), address };
+}
+
+// CALL and conditional CALL, RST except RST 38h, whose opcode 0xFF fills unused memory
+bool followsCall( const IBus& bus, const uint16_t returnAddress ) {
+    if( returnAddress >= 3 ) {
+        const uint8_t opcode = bus.directMemRead( static_cast<uint16_t>( returnAddress - 3 ) );
+        if( opcode == 0xCD || ( opcode & 0xE7 ) == 0xC4 )
+            return true;
+    }
+    if( returnAddress >= 1 ) {
+        const uint8_t opcode = bus.directMemRead( static_cast<uint16_t>( returnAddress - 1 ) );
+        return ( opcode & 0xC7 ) == 0xC7 && opcode != 0xFF;
+    }
+    return false;
+}
+
+bool before( const PcSampler::Location& left, const PcSampler::Location& right ) {
+    return std::tie( left.bank, left.address ) < std::tie( right.bank, right.address );
+}
+
+std::string_view trim( std::string_view text ) {
+    const auto first = text.find_first_not_of( " \t\r" );
+    if( first == std::string_view::npos )
+        return {};
+    return text.substr( first, text.find_last_not_of( " \t\r" ) - first + 1 );
+}
+} // namespace
+
+//--------------------------------------------------
+void PcSampler::start( const unsigned period_, const std::size_t capacity ) {
+    buffer.assign( std::max<std::size_t>( capacity, 1 ), {} );
+    next        = 0;
+    taken       = 0;
+    period      = period_;
+    untilSample = period_;
+}
+
+void PcSampler::record( const IBus& bus, const uint16_t pc, const uint16_t sp, const unsigned count ) {
+    Sample& sample   = buffer[next];
+    sample.frames[0] = locationOf( bus, pc );
+    sample.depth     = 1;
+    // Top of the stack isn't known, so only a bounded number of words is scanned
+    constexpr unsigned scannedWords = 32;
+    uint32_t address                = sp;
+    for( unsigned i = 0; i < scannedWords && address < 0xFFFE && sample.depth < maxFrames; i++ ) {
+        const uint8_t low    = bus.directMemRead( static_cast<uint16_t>( address ) );
+        const uint8_t high   = bus.directMemRead( static_cast<uint16_t>( address + 1 ) );
+        const uint16_t value = static_cast<uint16_t>( high << 8 | low );
+        if( followsCall( bus, value ) )
+            sample.frames[sample.depth++] = locationOf( bus, value );
+        address += 2;
+    }
+    const std::size_t copies = std::min<std::size_t>( count, buffer.size() );
+    for( std::size_t i = 1; i < copies; i++ )
+        buffer[( next + i ) % buffer.size()] = sample;
+    next = ( next + count ) % buffer.size();
+    taken += count;
+}
+
+std::vector<PcSampler::Sample> PcSampler::samples() const {
+    if( taken < buffer.size() )
+        return { buffer.begin(), buffer.begin() + static_cast<std::ptrdiff_t>( taken ) };
+    std::vector<Sample> ordered( buffer.begin() + static_cast<std::ptrdiff_t>( next ), buffer.end() );
+    ordered.insert( ordered.end(), buffer.begin(), buffer.begin() + static_cast<std::ptrdiff_t>( next ) );
+    return ordered;
+}
+
+//--------------------------------------------------
+SymbolTable::SymbolTable( std::string_view symFile ) {
+    while( ! symFile.empty() ) {
+        const std::size_t lineEnd = std::min( symFile.find( '\n' ), symFile.size() );
+        std::string_view line     = symFile.substr( 0, lineEnd );
+        symFile.remove_prefix( std::min( lineEnd + 1, symFile.size() ) );
+
+        line                    = trim( line.substr( 0, line.find( ';' ) ) );
+        const std::size_t colon = line.find( ':' );
+        const std::size_t space = line.find_first_of( " \t" );
+        if( colon == std::string_view::npos || space == std::string_view::npos || colon > space )
+            continue;
+        unsigned bank = 0, address = 0;
+        if( std::from_chars( line.data(), line.data() + colon, bank, 16 ).ec != std::errc {} ||
+            std::from_chars( line.data() + colon + 1, line.data() + space, address, 16 ).ec != std::errc {} ||
+            address > 0xFFFF )
+            continue;
+        const std::string_view name = trim( line.substr( space ) );
+        if( name.empty() || name.find( '.' ) != std::string_view::npos )
+            continue;
+        // Banks of other memory than switchable ROM aren't told apart by samples
+        if( address < 0x4000 || address >= 0x8000 )
+            bank = 0;
+        symbols.push_back( { { static_cast<uint16_t>( bank ), static_cast<uint16_t>( address ) },
+                             std::string( name ) } );
+    }
+    std::ranges::stable_sort( symbols, before, &Symbol::location );
+}
+
+std::string SymbolTable::nameOf( const PcSampler::Location location ) const {
+    const auto it = std::ranges::upper_bound( symbols, location, before, &Symbol::location );
+    if( it != symbols.begin() && std::prev( it )->location.bank == location.bank )
+        return std::prev( it )->name;
+    return std::format( "{:02X}:{:04X}", location.bank, location.address );
+}
+
+//--------------------------------------------------
+std::string flatProfile( const std::vector<PcSampler::Sample>& samples, const SymbolTable& symbols ) {
+    struct Counts {
+        uint64_t self  = 0;
+        uint64_t total = 0;
+    };
+    std::map<std::string, Counts> functions;
+    for( const auto& sample: samples ) {
+        std::vector<std::string> names;
+        for( uint8_t i = 0; i < sample.depth; i++ )
+            names.push_back( symbols.nameOf( sample.frames[i] ) );
+        functions[names.front()].self++;
+        std::ranges::sort( names );
+        const auto [uniqueEnd, end] = std::ranges::unique( names );
+        names.erase( uniqueEnd, end ); // recursion counts once
+        for( const auto& name: names )
+            functions[name].total++;
+    }
+
+    std::vector<std::pair<std::string, Counts>> ordered( functions.begin(), functions.end() );
+    std::ranges::stable_sort( ordered, []( const auto& left, const auto& right ) {
+        return left.second.self > right.second.self;
+    } );
+    std::string profile = "# self% self total function\n";
+    for( const auto& [name, counts]: ordered ) {
+        const uint64_t hundredths = counts.self * 10000 / samples.size();
+        profile += std::format( "{:3}.{:02} {} {} {}\n", hundredths / 100, hundredths % 100, counts.self,
+                                counts.total, name );
+    }
+    return profile;
+}
+
+std::string collapsedStacks( const std::vector<PcSampler::Sample>& samples, const SymbolTable& symbols ) {
+    std::map<std::string, uint64_t> stacks;
+    for( const auto& sample: samples ) {
+        std::string stack;
+        for( unsigned i = sample.depth; i-- > 0; ) {
+            stack += symbols.nameOf( sample.frames[i] );
+            if( i )
+                stack += ';';
+        }
+        stacks[stack]++;
+    }
+    std::string collapsed;
+    for( const auto& [stack, count]: stacks )
+        collapsed += std::format( "{} {}\n", stack, count );
+    return collapsed;
+}
@@ -1,44 +1,16 @@
 #include "core/timer.hpp"
 #include "core/core_constants.hpp"
+#include <limits>
 
-void Timer::tick() {
-    masterCounter++;
-    bus.write( addr::divider, static_cast<uint8_t>( masterCounter >> 8 ) );
+unsigned Timer::cyclesUntilOverflow() const {
     const auto timerControl = bus.read( addr::timerControl );
-    const bool timaEnabled  = timerControl & ( 1 << 2 );
-    unsigned mask           = 0;
-    const auto clockSelect  = static_cast<ClockSelect>( timerControl & 0x3 );
-    if( timaEnabled ) {
-        switch( clockSelect ) {
-            using enum ClockSelect;
-        case every16Tcycles:
-            mask = 1 << 3;
-            break;
-        case every64Tcycles:
-            mask = 1 << 5;
-            break;
-        case every256Tcycles:
-            mask = 1 << 7;
-            break;
-        case every1024Tcycles:
-            mask = 1 << 9;
-            break;
-        }
-    }
-
-    bool newAndResult = masterCounter & mask;
-    // increment on falling edge
-    if( previousAndResult && ! newAndResult ) {
-        uint8_t tima = bus.read( addr::timerCounter );
-
-        if( tima == 0xFF ) {
-            bus.write( addr::timerCounter, bus.read( addr::timerModulo ) );
-            bus.write( addr::interruptFlag, bus.read( addr::interruptFlag ) | bitMask::timerInterrupt );
-        } else {
-            bus.write( addr::timerCounter, tima + 1 );
-        }
-    }
-    previousAndResult = newAndResult;
+    if( ! ( timerControl & ( 1 << 2 ) ) )
+        return std::numeric_limits<unsigned>::max();
+    // TIMA is incremented every time masterCounter becomes a multiple of period
+    constexpr unsigned periods[] = { 1024, 16, 64, 256 };
+    const unsigned period        = periods[timerControl & 0x3];
+    const unsigned tima          = bus.read( addr::timerCounter );
+    return period - masterCounter % period + ( 0xFF - tima ) * period;
 }
 
 void Timer::write( uint16_t address, uint8_t value ) {
@@ -2,25 +2,56 @@
 #include "core/cartridge.hpp"
 #include "core/emulator.hpp"
 #include "core/logging.hpp"
+#include "core/pc_sampler.hpp"
 #include "raylib/raylib_handle_joypad.hpp"
 #include "raylib/raylib_ppu.hpp"
 #include "tinyfiledialogs.h"
+#include <charconv>
 #include <filesystem>
 #include <format>
 #include <fstream>
+#include <iterator>
 #include <limits>
 #include <memory>
+#include <optional>
 #include <raylib.h>
+#include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
-using Emulator_t            = Emulator<RaylibPpu>;
+using Emulator_t            = Emulator<RaylibPpu, Cpu, Memory, Debugger>;
 constexpr int targetFps     = 60;
 constexpr int ticksPerFrame = ( 1. / targetFps ) * constant::tickrate;
+// Of the sampling profiler, the default period takes 1024 samples per emulated second
+constexpr unsigned defaultSamplePeriod = 4096;
+constexpr std::size_t sampleCapacity   = 1 << 18;
 
 
-int main() {
+// Usage: gb_raylib_executable [--sample <symbols.sym> [period in T-cycles]]
+int main( int argc, char* argv[] ) {
     setLogLevel( LogLevel::Info );
+
+    std::optional<SymbolTable> symbols;
+    unsigned samplePeriod = defaultSamplePeriod;
+    if( argc > 2 && std::string_view( argv[1] ) == "--sample" ) {
+        std::ifstream symFile( argv[2] );
+        if( ! symFile.good() ) {
+            logFatal( 0, "Failed to open symbol file: " + std::string( argv[2] ) );
+            return 1;
+        }
+        symbols.emplace( std::string( std::istreambuf_iterator<char>( symFile ), {} ) );
+        if( argc > 3 ) {
+            const std::string_view period( argv[3] );
+            const char* periodEnd   = period.data() + period.size();
+            const auto [end, error] = std::from_chars( period.data(), periodEnd, samplePeriod );
+            if( error != std::errc {} || end != periodEnd || samplePeriod == 0 ) {
+                logFatal( 0, "Invalid sampling period: " + std::string( period ) );
+                return 1;
+            }
+        }
+    }
+
     // clang-format off
     auto romPath = tinyfd_openFileDialog(
         "Choose cartridge",    // dialog title
@@ -60,25 +91,26 @@ int main() {
             LoadTextureFromImage( GenImageColor( CorePpu::displayWidth, CorePpu::displayHeight, BLACK ) );
 
     Emulator_t emu( std::move( cartridge ), raylibHandleJoypad );
+    if( symbols )
+        emu.sampler.start( samplePeriod, sampleCapacity );
     bool interactiveDebugMode = true;
-    bool emulationStopped     = false;
-    bool doOneTick; // When emulation isn't stopped, the value doesn't matter
     while( ! WindowShouldClose() ) {
         if( IsKeyPressed( KEY_C ) ) {
             interactiveDebugMode = ! interactiveDebugMode;
-            emulationStopped     = false;
+            emu.debugger.resume();
         }
         if( interactiveDebugMode && IsKeyPressed( KEY_H ) ) {
-            emulationStopped = ! emulationStopped;
-            if( emulationStopped )
-                logLiveDebug( "Stopped emulation!" );
-            else
+            if( emu.debugger.stopped() ) {
+                emu.debugger.resume();
                 logLiveDebug( "Start emulation again!" );
+            } else
+                emu.debugger.pause();
         }
         if( interactiveDebugMode && IsKeyPressed( KEY_U ) )
             logSeparator();
-        if( interactiveDebugMode && IsKeyPressed( KEY_J ) )
-            doOneTick = true;
+        // Executes one instruction
+        if( interactiveDebugMode && IsKeyPressed( KEY_J ) && emu.debugger.stopped() )
+            emu.debugger.step();
         if( IsKeyPressed( KEY_KP_ADD ) ) {
             setLogLevel( LogLevel( std::max( std::to_underlying( getLogLevel() ) - 1, 0 ) ) );
             logLiveDebug( std::format( "Log level decreased to {}", std::to_underlying( getLogLevel() ) ) );
@@ -90,19 +122,16 @@ int main() {
         }
 
         BeginDrawing();
-        if( ! emulationStopped ) {
+        if( ! emu.debugger.stopped() ) {
             int cycles = 0;
-            while( cycles <= ticksPerFrame ) {
-                cycles += emu.tick();
+            while( cycles <= ticksPerFrame && ! emu.debugger.stopped() ) {
+                cycles += emu.tick( static_cast<unsigned>( ticksPerFrame - cycles ) );
                 logSeparator();
             }
-            UpdateTexture( screenTexture, emu.ppu.getScreenBuffer() );
-        } else if( doOneTick ) {
-            emu.tick();
-            logSeparator();
+            if( emu.debugger.stopped() )
+                logLiveDebug( std::format( "Stopped emulation at PC: {}", toHex( emu.cpu.getPC() ) ) );
             UpdateTexture( screenTexture, emu.ppu.getScreenBuffer() );
         }
-        doOneTick = false;
 
         ClearBackground( DARKGRAY );
         DrawTexturePro(
@@ -122,6 +151,18 @@ int main() {
         EndDrawing();
     }
 
+#ifdef CPU_PROFILING
+    std::ofstream( "execution_profile.csv" ) << emu.executionProfile().toCsv();
+    std::ofstream( "execution_profile.json" ) << emu.executionProfile().toJson();
+#endif
+#ifdef BUS_PROFILING
+    std::ofstream( "bus_heatmap.csv" ) << emu.busHeatmap().toCsv();
+#endif
+    if( symbols ) {
+        const auto samples = emu.sampler.samples();
+        std::ofstream( "flat_profile.txt" ) << flatProfile( samples, *symbols );
+        std::ofstream( "stacks.folded" ) << collapsedStacks( samples, *symbols );
+    }
     UnloadTexture( screenTexture );
     CloseWindow();
     return 0;
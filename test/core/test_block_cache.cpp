@@ -0,0 +1,367 @@
+#include "core/cached_cpu.hpp"
+#include "core/emulator.hpp"
+#include "dummy_types.hpp"
+#ifdef JIT_X86_64
+#include "core/jit_cpu.hpp"
+#endif
+#include <catch2/catch_test_macros.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+class BankedCartridge final : public CoreCartridge {
+public:
+    unsigned bank = 1;
+
+    uint8_t read( uint16_t ) override {
+        return 0xFF;
+    }
+    void write( uint16_t, uint8_t ) override {
+    }
+    unsigned mappedRomBank( const uint16_t address ) const override {
+        return address < 0x4000 ? 0 : bank;
+    }
+    BankedCartridge() : CoreCartridge( std::vector<uint8_t>( addr::globalChecksumEnd + 1 ) ) {
+    }
+};
+
+class BlockCacheCpu final : public CachedCpu {
+public:
+    using CachedCpu::blocks;
+    using CachedCpu::chunkBlocks;
+    using CachedCpu::chunkSize;
+    using CachedCpu::interruptMasterEnabled;
+    using CachedCpu::PC;
+
+    BlockCacheCpu( IBus& bus_ ) : CachedCpu( bus_ ) {
+    }
+};
+
+using CachedEmulator = Emulator<DummyPpu, BlockCacheCpu, Flat64KMemory>;
+
+// LD A, value; JR -4
+void writeLoop( CachedEmulator& emu, uint16_t address, uint8_t value ) {
+    const uint8_t code[] = { 0x3E, value, 0x18, 0xFC };
+    for( uint16_t i = 0; i < sizeof( code ); i++ )
+        emu.directMemWrite( static_cast<uint16_t>( address + i ), code[i] );
+}
+
+TEST_CASE( "Block cache invalidates self-modified RAM code", "[cpu][block_cache]" ) {
+    CachedEmulator emu( std::make_unique<BankedCartridge>(), dummyJoypadHandler );
+    writeLoop( emu, addr::workRam00, 0x11 );
+    emu.cpu.PC = addr::workRam00;
+
+    emu.tick();
+    emu.tick();
+    REQUIRE( emu.cpu.readR8( Cpu::Operand_t::a ) == 0x11 );
+    REQUIRE( emu.cpu.blocks.size() == 1 );
+
+    emu.write( addr::workRam00 + 1, 0x22 );
+    REQUIRE( emu.cpu.blocks.empty() );
+    emu.tick();
+    REQUIRE( emu.cpu.readR8( Cpu::Operand_t::a ) == 0x22 );
+    REQUIRE( emu.cpu.PC == addr::workRam00 + 2 );
+}
+
+TEST_CASE( "Block cache ignores IO writes and lists a block once per chunk", "[cpu][block_cache]" ) {
+    CachedEmulator emu( std::make_unique<BankedCartridge>(), dummyJoypadHandler );
+    writeLoop( emu, addr::highRam, 0x11 );
+    emu.cpu.PC = addr::highRam;
+    emu.tick();
+    emu.tick();
+    REQUIRE( emu.cpu.blocks.size() == 1 );
+    // Same chunk as high RAM
+    emu.write( addr::interruptEnableRegister, 0 );
+    emu.write( addr::lcdY, 0 );
+    REQUIRE( emu.cpu.blocks.size() == 1 );
+
+    // Block crossing into the next chunk, dropped and translated again through the first one
+    const uint16_t address = addr::workRam00 + BlockCacheCpu::chunkSize - 2;
+    writeLoop( emu, address, 0x11 );
+    emu.cpu.PC = address;
+    for( const uint8_t value: { uint8_t { 0x22 }, uint8_t { 0x33 } } ) {
+        emu.tick();
+        emu.tick();
+        emu.write( address + 1, value );
+    }
+    emu.tick();
+    REQUIRE( emu.cpu.readR8( Cpu::Operand_t::a ) == 0x33 );
+    REQUIRE( emu.cpu.chunkBlocks[( address + 2u - 0x8000u ) / BlockCacheCpu::chunkSize].size() == 1 );
+}
+
+TEST_CASE( "Block cache keys ROM blocks by mapped bank", "[cpu][block_cache]" ) {
+    auto cartridge   = std::make_unique<BankedCartridge>();
+    auto& bankedCart = *cartridge;
+    CachedEmulator emu( std::move( cartridge ), dummyJoypadHandler );
+    writeLoop( emu, addr::rom0N, 0x11 );
+    emu.cpu.PC = addr::rom0N;
+
+    emu.tick();
+    emu.tick();
+    REQUIRE( emu.cpu.readR8( Cpu::Operand_t::a ) == 0x11 );
+
+    // Switch to bank 2, flat memory stands in for its content
+    bankedCart.bank = 2;
+    emu.write( 0x2000, 2 );
+    writeLoop( emu, addr::rom0N, 0x22 );
+    emu.tick();
+    emu.tick();
+    REQUIRE( emu.cpu.readR8( Cpu::Operand_t::a ) == 0x22 );
+    REQUIRE( emu.cpu.blocks.size() == 2 );
+
+    // Block of bank 1 is still cached and must be picked again
+    bankedCart.bank = 1;
+    emu.write( 0x2000, 1 );
+    emu.tick();
+    REQUIRE( emu.cpu.readR8( Cpu::Operand_t::a ) == 0x11 );
+    REQUIRE( emu.cpu.blocks.size() == 2 );
+}
+
+// Runs code at 0xC000 with LCD on until it reaches JR -2 at stopAddress, returns elapsed T-cycles
+template<std::size_t N>
+unsigned runPolling( CachedEmulator& emu, const uint8_t ( &code )[N], const uint16_t stopAddress ) {
+    for( uint16_t i = 0; i < N; i++ )
+        emu.directMemWrite( static_cast<uint16_t>( addr::workRam00 + i ), code[i] );
+    emu.directMemWrite( addr::lcdControl, 0x80 );
+    emu.directMemWrite( addr::lcdStatus, 0 );
+    emu.directMemWrite( addr::lcdY, 0 );
+    emu.directMemWrite( addr::timerControl, 0 );
+    emu.directMemWrite( addr::interruptEnableRegister, 0 );
+    emu.cpu.PC = addr::workRam00;
+
+    unsigned tCycles = 0;
+    while( emu.cpu.PC != stopAddress )
+        tCycles += emu.tick();
+    return tCycles;
+}
+
+TEST_CASE( "Idle loops are skipped up to the change of the polled register", "[cpu][block_cache][idle]" ) {
+    // LDH A, (LY); CP 144; JR NZ, -6; JR -2
+    const uint8_t waitForLy[] = { 0xF0, 0x44, 0xFE, 0x90, 0x20, 0xFA, 0x18, 0xFE };
+    // LD A, (STAT); AND 3; CP 1; JP NZ, 0xC000; JR -2
+    const uint8_t waitForVBlankMode[] = { 0xFA, 0x41, 0xFF, 0xE6, 0x03, 0xFE,
+                                          0x01, 0xC2, 0x00, 0xC0, 0x18, 0xFE };
+
+    for( const bool skipping: { false, true } ) {
+        CachedEmulator stepped( std::make_unique<BankedCartridge>(), dummyJoypadHandler );
+        CachedEmulator skipped( std::make_unique<BankedCartridge>(), dummyJoypadHandler );
+        stepped.cpu.idleLoopSkipping = false;
+        skipped.cpu.idleLoopSkipping = skipping;
+
+        REQUIRE( runPolling( skipped, waitForLy, addr::workRam00 + 6 ) ==
+                 runPolling( stepped, waitForLy, addr::workRam00 + 6 ) );
+        REQUIRE( skipped.read( addr::lcdY ) == stepped.read( addr::lcdY ) );
+        REQUIRE( skipped.cpu.readR8( Cpu::Operand_t::f ) == stepped.cpu.readR8( Cpu::Operand_t::f ) );
+
+        REQUIRE( runPolling( skipped, waitForVBlankMode, addr::workRam00 + 10 ) ==
+                 runPolling( stepped, waitForVBlankMode, addr::workRam00 + 10 ) );
+        REQUIRE( skipped.read( addr::lcdY ) == stepped.read( addr::lcdY ) );
+        REQUIRE( skipped.cpu.readR8( Cpu::Operand_t::a ) == stepped.cpu.readR8( Cpu::Operand_t::a ) );
+
+        REQUIRE( stepped.cpu.skippedIdleCycles == 0 );
+        REQUIRE( ( skipped.cpu.skippedIdleCycles > 0 ) == skipping );
+    }
+}
+
+TEST_CASE( "Idle loops aren't skipped with an interrupt pending", "[cpu][block_cache][idle]" ) {
+    // LDH A, (LY); CP 144; JR NZ, -6
+    const uint8_t waitForLy[] = { 0xF0, 0x44, 0xFE, 0x90, 0x20, 0xFA };
+    CachedEmulator emu( std::make_unique<BankedCartridge>(), dummyJoypadHandler );
+    for( uint16_t i = 0; i < sizeof( waitForLy ); i++ )
+        emu.directMemWrite( static_cast<uint16_t>( addr::workRam00 + i ), waitForLy[i] );
+    emu.directMemWrite( addr::lcdControl, 0x80 );
+    emu.directMemWrite( addr::lcdY, 0 );
+    emu.directMemWrite( addr::timerControl, 0 );
+    emu.write( addr::interruptEnableRegister, 0 );
+    emu.cpu.PC                     = addr::workRam00;
+    emu.cpu.interruptMasterEnabled = true;
+
+    // One iteration, the next one could be skipped
+    do
+        emu.tick();
+    while( emu.cpu.PC != addr::workRam00 );
+    emu.write( addr::interruptEnableRegister, bitMask::vBlankInterrupt );
+    emu.write( addr::interruptFlag, bitMask::vBlankInterrupt );
+
+    while( emu.cpu.PC != 0x0040 ) // V-blank interrupt handler
+        REQUIRE( emu.tick() < 40 );
+    REQUIRE( emu.cpu.skippedIdleIterations == 0 );
+}
+
+TEST_CASE( "Fused instruction sequences match unfused execution", "[cpu][block_cache][fusion]" ) {
+    // LD HL, 0xC100; LD DE, 0xC200; LD BC, 16
+    // loop: LD A, (HL+); LD (DE), A; INC DE; DEC BC; LD A, B; OR C; JR NZ, loop
+    // LDH A, (LY); CP 144; JR -2
+    const uint8_t copyLoop[] = { 0x21, 0x00, 0xC1, 0x11, 0x00, 0xC2, 0x01, 0x10, 0x00, 0x2A, 0x12,
+                                 0x13, 0x0B, 0x78, 0xB1, 0x20, 0xF8, 0xF0, 0x44, 0xFE, 0x90, 0x18, 0xFE };
+    const uint16_t stopAddress = addr::workRam00 + sizeof( copyLoop ) - 2;
+
+    CachedEmulator fused( std::make_unique<BankedCartridge>(), dummyJoypadHandler );
+    CachedEmulator unfused( std::make_unique<BankedCartridge>(), dummyJoypadHandler );
+    unfused.cpu.fusion = false;
+    for( auto* emu: { &fused, &unfused } )
+        for( uint16_t i = 0; i < 16; i++ )
+            emu->directMemWrite( static_cast<uint16_t>( 0xC100 + i ), static_cast<uint8_t>( 0x30 + i ) );
+
+    REQUIRE( runPolling( fused, copyLoop, stopAddress ) == runPolling( unfused, copyLoop, stopAddress ) );
+    for( const auto r: { Cpu::Operand_t::a, Cpu::Operand_t::f } )
+        REQUIRE( fused.cpu.readR8( r ) == unfused.cpu.readR8( r ) );
+    for( const auto r: { Cpu::Operand_t::bc, Cpu::Operand_t::de, Cpu::Operand_t::hl } )
+        REQUIRE( fused.cpu.readR16( r ) == unfused.cpu.readR16( r ) );
+    for( uint16_t i = 0; i < 16; i++ )
+        REQUIRE( fused.read( static_cast<uint16_t>( 0xC200 + i ) ) == 0x30 + i );
+
+    REQUIRE( unfused.cpu.fusedSequences == 0 );
+    REQUIRE( fused.cpu.fusedSequences > 0 );
+}
+
+TEST_CASE( "Bulk loops match their step by step execution", "[cpu][block_cache][bulk]" ) {
+    // LD HL, 0xC100; LD DE, 0x8000; LD BC, 0x200
+    // copy: LD A, (HL+); LD (DE), A; INC DE; DEC BC; LD A, B; OR C; JR NZ, copy
+    // LD HL, 0xD000; LD A, 0x5A; LD B, 0
+    // fill: LD (HL+), A; DEC B; JR NZ, fill
+    // JR -2
+    const uint8_t copyAndFill[] = { 0x21, 0x00, 0xC1, 0x11, 0x00, 0x80, 0x01, 0x00, 0x02, 0x2A,
+                                    0x12, 0x13, 0x0B, 0x78, 0xB1, 0x20, 0xF8, 0x21, 0x00, 0xD0,
+                                    0x3E, 0x5A, 0x06, 0x00, 0x22, 0x05, 0x20, 0xFC, 0x18, 0xFE };
+    const uint16_t stopAddress = addr::workRam00 + sizeof( copyAndFill ) - 2;
+
+    CachedEmulator bulk( std::make_unique<BankedCartridge>(), dummyJoypadHandler );
+    CachedEmulator stepped( std::make_unique<BankedCartridge>(), dummyJoypadHandler );
+    stepped.cpu.bulkTransfers = false;
+    for( auto* emu: { &bulk, &stepped } )
+        for( uint16_t i = 0; i < 0x200; i++ )
+            emu->directMemWrite( static_cast<uint16_t>( 0xC100 + i ), static_cast<uint8_t>( i * 7 ) );
+
+    // VRAM gets locked during the copy, bulk transfers have to stop before it
+    REQUIRE( runPolling( bulk, copyAndFill, stopAddress ) == runPolling( stepped, copyAndFill, stopAddress ) );
+    for( const auto r: { Cpu::Operand_t::a, Cpu::Operand_t::f, Cpu::Operand_t::b, Cpu::Operand_t::c } )
+        REQUIRE( bulk.cpu.readR8( r ) == stepped.cpu.readR8( r ) );
+    for( const auto r: { Cpu::Operand_t::de, Cpu::Operand_t::hl } )
+        REQUIRE( bulk.cpu.readR16( r ) == stepped.cpu.readR16( r ) );
+    for( uint16_t i = 0; i < 0x200; i++ )
+        REQUIRE( bulk.directMemRead( static_cast<uint16_t>( addr::videoRam + i ) ) ==
+                 stepped.directMemRead( static_cast<uint16_t>( addr::videoRam + i ) ) );
+    for( uint16_t i = 0; i < 0x100; i++ )
+        REQUIRE( bulk.directMemRead( static_cast<uint16_t>( 0xD000 + i ) ) == 0x5A );
+
+    REQUIRE( stepped.cpu.bulkTransferredBytes == 0 );
+    REQUIRE( bulk.cpu.bulkTransferredBytes > 0x100 );
+}
+
+TEST_CASE( "Bulk loops stop before writing to the chunk of their code", "[cpu][block_cache][bulk]" ) {
+    // copy at 0xC11A: LD A, (HL+); LD (DE), A; INC DE; DEC BC; LD A, B; OR C; JR NZ, copy; JR -2
+    const uint8_t copy[]       = { 0x2A, 0x12, 0x13, 0x0B, 0x78, 0xB1, 0x20, 0xF8, 0x18, 0xFE };
+    const uint16_t copyAddress = 0xC11A;
+    // Destination and its echo, both reaching the chunk from 0xC100
+    for( const uint16_t destination: { uint16_t { 0xC0F0 }, uint16_t { 0xE0F0 } } ) {
+        // LD HL, 0xD000; LD DE, destination; LD BC, 0x20; JP copy
+        const uint8_t setup[] = { 0x21, 0x00, 0xD0, 0x11, lsb( destination ), msb( destination ),
+                                  0x01, 0x20, 0x00, 0xC3, lsb( copyAddress ), msb( copyAddress ) };
+
+        CachedEmulator bulk( std::make_unique<BankedCartridge>(), dummyJoypadHandler );
+        CachedEmulator stepped( std::make_unique<BankedCartridge>(), dummyJoypadHandler );
+        stepped.cpu.bulkTransfers = false;
+        for( auto* emu: { &bulk, &stepped } ) {
+            for( uint16_t i = 0; i < sizeof( copy ); i++ )
+                emu->directMemWrite( static_cast<uint16_t>( copyAddress + i ), copy[i] );
+            for( uint16_t i = 0; i < 0x20; i++ )
+                emu->directMemWrite( static_cast<uint16_t>( 0xD000 + i ), static_cast<uint8_t>( i + 1 ) );
+        }
+
+        const uint16_t stopAddress = copyAddress + sizeof( copy ) - 2;
+        REQUIRE( runPolling( bulk, setup, stopAddress ) == runPolling( stepped, setup, stopAddress ) );
+        for( const auto r: { Cpu::Operand_t::a, Cpu::Operand_t::f } )
+            REQUIRE( bulk.cpu.readR8( r ) == stepped.cpu.readR8( r ) );
+        for( const auto r: { Cpu::Operand_t::bc, Cpu::Operand_t::de, Cpu::Operand_t::hl } )
+            REQUIRE( bulk.cpu.readR16( r ) == stepped.cpu.readR16( r ) );
+        for( uint16_t i = 0; i < 0x20; i++ )
+            REQUIRE( bulk.directMemRead( static_cast<uint16_t>( destination + i ) ) == i + 1 );
+        // Bytes before the chunk are still moved at once
+        REQUIRE( bulk.cpu.bulkTransferredBytes > 0 );
+        REQUIRE( bulk.cpu.bulkTransferredBytes < 0x10 );
+    }
+}
+
+#ifdef JIT_X86_64
+class JitTestCpu final : public JitCpu {
+public:
+    using JitCpu::blocks;
+    using JitCpu::interruptMasterEnabled;
+    using JitCpu::PC;
+
+    JitTestCpu( IBus& bus_ ) : JitCpu( bus_ ) {
+        hotThreshold = 2;
+    }
+};
+
+// Fills 16 bytes from 0xC100 with 0..15 and stops in JR -2 at 0xC00A
+template<typename Tcpu>
+unsigned runFillLoop( Emulator<DummyPpu, Tcpu, Flat64KMemory>& emu ) {
+    const uint8_t code[] = { 0x21, 0x00, 0xC1, 0x06, 0x10, 0x22, 0x3C, 0x05, 0x20, 0xFB, 0x18, 0xFE };
+    for( uint16_t i = 0; i < sizeof( code ); i++ )
+        emu.directMemWrite( static_cast<uint16_t>( addr::workRam00 + i ), code[i] );
+    emu.cpu.writeR8( Cpu::Operand_t::a, 0 );
+    emu.cpu.PC = addr::workRam00;
+
+    unsigned tCycles = 0;
+    while( emu.cpu.PC != addr::workRam00 + 0xA )
+        tCycles += emu.tick();
+    return tCycles;
+}
+
+TEST_CASE( "JIT compiled loop matches the interpreter", "[cpu][block_cache][jit]" ) {
+    CachedEmulator interpreted( std::make_unique<BankedCartridge>(), dummyJoypadHandler );
+    Emulator<DummyPpu, JitTestCpu, Flat64KMemory> compiled( std::make_unique<BankedCartridge>(),
+                                                            dummyJoypadHandler );
+
+    const unsigned interpretedCycles = runFillLoop( interpreted );
+    REQUIRE( runFillLoop( compiled ) == interpretedCycles );
+    REQUIRE( compiled.cpu.blocks.at( addr::workRam00 + 5 ).compiled != nullptr );
+
+    for( const auto r: { Cpu::Operand_t::a, Cpu::Operand_t::b, Cpu::Operand_t::h, Cpu::Operand_t::l,
+                         Cpu::Operand_t::f } )
+        REQUIRE( compiled.cpu.readR8( r ) == interpreted.cpu.readR8( r ) );
+    for( uint16_t i = 0; i < 16; i++ )
+        REQUIRE( compiled.read( static_cast<uint16_t>( 0xC100 + i ) ) == i );
+}
+
+// Counts up B, C, D and E in a loop with the timer overflowing in its fourth iteration,
+// stops at the timer interrupt handler
+template<typename Tcpu>
+unsigned runUntilTimerInterrupt( Emulator<DummyPpu, Tcpu, Flat64KMemory>& emu ) {
+    // 4 * ( INC B; INC C; INC D; INC E ); JR -18
+    const uint8_t code[] = { 0x04, 0x0C, 0x14, 0x1C, 0x04, 0x0C, 0x14, 0x1C, 0x04,
+                             0x0C, 0x14, 0x1C, 0x04, 0x0C, 0x14, 0x1C, 0x18, 0xEE };
+    for( uint16_t i = 0; i < sizeof( code ); i++ )
+        emu.directMemWrite( static_cast<uint16_t>( addr::workRam00 + i ), code[i] );
+    emu.write( addr::divider, 0 );
+    emu.write( addr::timerCounter, 0xF0 );
+    emu.write( addr::timerControl, 0x05 ); // enabled, increments every 16 T-cycles
+    emu.write( addr::interruptEnableRegister, bitMask::timerInterrupt );
+    emu.cpu.PC                     = addr::workRam00;
+    emu.cpu.interruptMasterEnabled = true;
+
+    unsigned tCycles = 0;
+    while( emu.cpu.PC != 0x0050 )
+        tCycles += emu.tick();
+    return tCycles;
+}
+
+TEST_CASE( "JIT compiled block doesn't delay interrupts", "[cpu][block_cache][jit]" ) {
+    CachedEmulator interpreted( std::make_unique<BankedCartridge>(), dummyJoypadHandler );
+    Emulator<DummyPpu, JitTestCpu, Flat64KMemory> compiled( std::make_unique<BankedCartridge>(),
+                                                            dummyJoypadHandler );
+
+    const unsigned interpretedCycles = runUntilTimerInterrupt( interpreted );
+    REQUIRE( runUntilTimerInterrupt( compiled ) == interpretedCycles );
+    REQUIRE( compiled.cpu.blocks.at( addr::workRam00 ).compiled != nullptr );
+
+    for( const auto r: { Cpu::Operand_t::b, Cpu::Operand_t::c, Cpu::Operand_t::d, Cpu::Operand_t::e } )
+        REQUIRE( compiled.cpu.readR8( r ) == interpreted.cpu.readR8( r ) );
+    // Return address of the interrupt
+    const uint16_t sp = compiled.cpu.readR16( Cpu::Operand_t::sp );
+    REQUIRE( sp == interpreted.cpu.readR16( Cpu::Operand_t::sp ) );
+    REQUIRE( compiled.read( sp ) == interpreted.read( sp ) );
+}
+#endif
@@ -1,7 +1,10 @@
 #include "core/core_constants.hpp"
 #include "core/cpu.hpp"
+#include "core/emulator.hpp"
+#include "core/fast_cpu.hpp"
 #include "dummy_types.hpp"
 #include <catch2/catch_test_macros.hpp>
+#include <cstddef>
 #include <memory>
 #include <utility>
 
@@ -32,14 +35,19 @@ TEST_CASE( "Cpu branch handling", "[cpu][branch]" ) {
     DummyBus bus;
     using MopType = Cpu::MicroOperationType_t;
     std::unique_ptr<DummyCpu> cpu;
+    const Cpu::MicroOperation_t checkCond[] = {
+            { MopType::CHECK_COND, Cpu::Operand_t::condZ }, MopType::INVALID, MopType::INVALID, MopType::END };
+    const Cpu::MicroOperation_t condCheckLdImmToZ[] = {
+            { MopType::COND_CHECK__LD_IMM_TO_Z, Cpu::Operand_t::condZ }, MopType::INVALID, MopType::INVALID,
+            MopType::END };
 
     cpu                                                     = std::make_unique<DummyCpu>( bus );
     cpu->registers[std::to_underlying( Cpu::Operand_t::f )] = 0; // all registers set to false
     cpu->PC                                                 = 0x100;
-    cpu->mopQueue = { { { MopType::CHECK_COND, Cpu::Operand_t::condZ }, MopType::INVALID, MopType::INVALID } };
+    cpu->mopQueue                                           = checkCond;
     cpu->tick();
-    REQUIRE( cpu->mopQueue[1].type == MopType::NOP );
-    REQUIRE( cpu->mopQueue[2].type == MopType::END );
+    REQUIRE( cpu->mopQueue[cpu->atMicroOperationNr].type == MopType::NOP );
+    REQUIRE( cpu->mopQueue[cpu->atMicroOperationNr + 1].type == MopType::END );
     cpu->tick();
     cpu->tick();
     REQUIRE( cpu->PC == 0x101 );
@@ -47,22 +55,175 @@ TEST_CASE( "Cpu branch handling", "[cpu][branch]" ) {
 
     cpu                                                     = std::make_unique<DummyCpu>( bus );
     cpu->registers[std::to_underlying( Cpu::Operand_t::f )] = 0xFF; // all registers set to true
-    cpu->mopQueue = { { { MopType::CHECK_COND, Cpu::Operand_t::condZ }, MopType::INVALID, MopType::INVALID } };
+    cpu->mopQueue                                           = checkCond;
     cpu->tick();
-    REQUIRE( cpu->mopQueue[1].type == MopType::INVALID );
-    REQUIRE( cpu->mopQueue[2].type == MopType::INVALID );
+    REQUIRE( cpu->mopQueue[cpu->atMicroOperationNr].type == MopType::INVALID );
+    REQUIRE( cpu->mopQueue[cpu->atMicroOperationNr + 1].type == MopType::INVALID );
 
     //--------------------------------------------------
     cpu                                                     = std::make_unique<DummyCpu>( bus );
     cpu->registers[std::to_underlying( Cpu::Operand_t::f )] = 0; // all registers set to false
     cpu->PC                                                 = 0x100;
-    cpu->mopQueue = { { { MopType::COND_CHECK__LD_IMM_TO_Z, Cpu::Operand_t::condZ },
-                        MopType::INVALID,
-                        MopType::INVALID } };
+    cpu->mopQueue                                           = condCheckLdImmToZ;
     cpu->tick();
-    REQUIRE( cpu->mopQueue[1].type == MopType::NOP );
-    REQUIRE( cpu->mopQueue[2].type == MopType::END );
+    REQUIRE( cpu->mopQueue[cpu->atMicroOperationNr].type == MopType::NOP );
+    REQUIRE( cpu->mopQueue[cpu->atMicroOperationNr + 1].type == MopType::END );
     cpu->tick();
     cpu->tick();
     REQUIRE( cpu->PC == 0x102 );
 }
+
+//--------------------------------------------------
+using HaltEmulator = Emulator<DummyPpu, DummyCpu, Flat64KMemory>;
+
+// Executes HALT and ticks until interrupt flag is set, returns elapsed T-cycles
+unsigned runHalted( HaltEmulator& emu, const uint8_t interrupt, const unsigned cycleBudget,
+                    unsigned& tickCalls ) {
+    emu.directMemWrite( addr::workRam00, 0x76 ); // HALT
+    emu.directMemWrite( addr::workRam00 + 1, 0x00 );
+    emu.directMemWrite( addr::interruptEnableRegister, interrupt );
+    emu.directMemWrite( addr::interruptFlag, 0 );
+    emu.cpu.PC = addr::workRam00;
+
+    unsigned tCycles = 0;
+    tickCalls        = 0;
+    while( ! ( emu.read( addr::interruptFlag ) & interrupt ) ) {
+        tCycles += emu.tick( cycleBudget );
+        tickCalls++;
+    }
+    return tCycles;
+}
+
+TEST_CASE( "HALT skips to the next enabled interrupt", "[cpu][halt]" ) {
+    // Budget of one M-cycle is the same as ticking without skipping, skipping must end up in the same state
+    unsigned vBlankCycles[2], timerCycles[2], vBlankTicks[2], timerTicks[2];
+    int run = 0;
+    for( const unsigned cycleBudget: { 4u, constant::frameDuration } ) {
+        HaltEmulator lcdOn( std::make_unique<DummyCartridge>(), dummyJoypadHandler );
+        lcdOn.directMemWrite( addr::lcdControl, 0x80 );
+        lcdOn.directMemWrite( addr::lcdY, 0 );
+        lcdOn.directMemWrite( addr::timerControl, 0 );
+        vBlankCycles[run] = runHalted( lcdOn, bitMask::vBlankInterrupt, cycleBudget, vBlankTicks[run] );
+        REQUIRE( lcdOn.read( addr::lcdY ) == 144 );
+
+        HaltEmulator timerOn( std::make_unique<DummyCartridge>(), dummyJoypadHandler );
+        timerOn.directMemWrite( addr::lcdControl, 0 );
+        timerOn.directMemWrite( addr::timerControl, 0x05 ); // every 16 T-cycles
+        timerOn.directMemWrite( addr::timerCounter, 0xF0 );
+        timerCycles[run] = runHalted( timerOn, bitMask::timerInterrupt, cycleBudget, timerTicks[run] );
+
+        // Woken up with IME off, execution continues after HALT
+        timerOn.tick();
+        REQUIRE( timerOn.cpu.PC == addr::workRam00 + 2 );
+        run++;
+    }
+    REQUIRE( vBlankCycles[1] == vBlankCycles[0] );
+    REQUIRE( timerCycles[1] == timerCycles[0] );
+    REQUIRE( vBlankTicks[1] <= 3 );
+    REQUIRE( timerTicks[1] <= 3 );
+}
+
+TEST_CASE( "Interrupt dispatch takes the highest priority pending interrupt", "[cpu][interrupt]" ) {
+    HaltEmulator emu( std::make_unique<DummyCartridge>(), dummyJoypadHandler );
+    emu.directMemWrite( addr::lcdControl, 0 );
+    emu.directMemWrite( addr::timerControl, 0 );
+    emu.directMemWrite( addr::workRam00, 0xFB ); // EI
+    emu.directMemWrite( addr::workRam00 + 1, 0x00 );
+    emu.directMemWrite( addr::interruptEnableRegister, bitMask::timerInterrupt | bitMask::serialInterrupt );
+    emu.write( addr::interruptFlag,
+               bitMask::vBlankInterrupt | bitMask::timerInterrupt | bitMask::serialInterrupt );
+    REQUIRE( emu.interrupts.pending() == ( bitMask::timerInterrupt | bitMask::serialInterrupt ) );
+    emu.cpu.PC = addr::workRam00;
+
+    for( int i = 0; i < 16 && emu.cpu.PC != 0x50; i++ )
+        emu.tick();
+    REQUIRE( emu.cpu.PC == 0x50 );
+    REQUIRE( emu.read( addr::interruptFlag ) == ( bitMask::vBlankInterrupt | bitMask::serialInterrupt ) );
+    REQUIRE( emu.interrupts.pending() == bitMask::serialInterrupt );
+}
+
+// Runs code at 0xC000 until its instructions took instructionCycles T-cycles, after the leading NOP of
+// the micro-operation queue, returns elapsed T-cycles
+template<std::size_t N>
+unsigned runCode( HaltEmulator& emu, const uint8_t ( &code )[N], const unsigned instructionCycles ) {
+    for( uint16_t i = 0; i < N; i++ )
+        emu.directMemWrite( static_cast<uint16_t>( addr::workRam00 + i ), code[i] );
+    emu.cpu.PC = addr::workRam00;
+
+    unsigned tCycles = 0;
+    while( tCycles < 4 + instructionCycles )
+        tCycles += emu.tick();
+    return tCycles;
+}
+
+TEST_CASE( "Flags of ALU operations are seen by PUSH AF", "[cpu][flags]" ) {
+    HaltEmulator emu( std::make_unique<DummyCartridge>(), dummyJoypadHandler );
+    // LD A, 0x0F; LD B, 0x01; ADD A, B; PUSH AF; SUB B; POP BC
+    const uint8_t code[] = { 0x3E, 0x0F, 0x06, 0x01, 0x80, 0xF5, 0x90, 0xC1 };
+    runCode( emu, code, 8 + 8 + 4 + 16 + 4 + 12 );
+    REQUIRE( emu.cpu.readR8( Cpu::Operand_t::c ) == 0x20 ); // half carry
+    REQUIRE( emu.cpu.readR8( Cpu::Operand_t::b ) == 0x10 );
+    REQUIRE( emu.cpu.readR8( Cpu::Operand_t::f ) == 0x60 );
+    REQUIRE( emu.cpu.readR8( Cpu::Operand_t::a ) == 0x0F );
+}
+
+class InvalidOpcodeCpu final : public FastCpu {
+public:
+    using FastCpu::FastCpu;
+    using FastCpu::PC;
+};
+
+TEST_CASE( "Fast CPU executes invalid opcodes in one M-cycle", "[cpu]" ) {
+    Emulator<DummyPpu, InvalidOpcodeCpu, Flat64KMemory> emu( std::make_unique<DummyCartridge>(),
+                                                             dummyJoypadHandler );
+    emu.directMemWrite( addr::lcdControl, 0 );
+    emu.directMemWrite( addr::interruptEnableRegister, 0 );
+    const uint8_t invalidOpcodes[] = { 0xD3, 0xDB, 0xDD, 0xE3, 0xE4, 0xEB, 0xEC, 0xED, 0xF4, 0xFC, 0xFD };
+    for( const uint8_t opcode: invalidOpcodes ) {
+        emu.directMemWrite( addr::workRam00, opcode );
+        emu.cpu.PC = addr::workRam00;
+        REQUIRE( emu.tick() == 4 );
+        REQUIRE( emu.cpu.PC == addr::workRam00 + 1 );
+    }
+}
+
+TEST_CASE( "Instruction fetches see pages remapped under the fetch window", "[cpu][fetch]" ) {
+    Emulator<DummyPpu, DummyCpu> emu( std::make_unique<DummyCartridge>(), dummyJoypadHandler );
+    emu.directMemWrite( addr::lcdControl, 0 );
+    emu.directMemWrite( addr::interruptEnableRegister, 0 );
+    // NOPs in VRAM, which reads 0xFF ( RST 38H ) once locked
+    emu.directMemWrite( addr::videoRam, 0x00 );
+    emu.directMemWrite( addr::videoRam + 1, 0x00 );
+    emu.cpu.PC = addr::videoRam;
+
+    for( int i = 0; i < 4 && emu.cpu.PC != addr::videoRam + 1; i++ )
+        emu.tick();
+    REQUIRE( emu.cpu.PC == addr::videoRam + 1 );
+    emu.setVramLock( true );
+    for( int i = 0; i < 8; i++ )
+        emu.tick();
+    REQUIRE( emu.cpu.PC < addr::rom0N );
+}
+
+#ifdef CPU_PROFILING
+TEST_CASE( "Execution profile counts opcodes and their micro-operations", "[cpu][profiling]" ) {
+    HaltEmulator emu( std::make_unique<DummyCartridge>(), dummyJoypadHandler );
+    // LD A, 0x0F; LD B, 0x01; ADD A, B; SWAP A
+    const uint8_t code[] = { 0x3E, 0x0F, 0x06, 0x01, 0x80, 0xCB, 0x37 };
+    emu.resetExecutionProfile();
+    const unsigned tCycles = runCode( emu, code, 8 + 8 + 4 + 8 );
+    const ExecutionProfile& profile = emu.executionProfile();
+    REQUIRE( profile.opcodes[0x3E].executions == 1 );
+    REQUIRE( profile.opcodes[0x3E].tCycles == 8 );
+    REQUIRE( profile.opcodes[0x80].tCycles == 4 );
+    REQUIRE( profile.opcodes[0x137].executions == 1 );
+    REQUIRE( profile.opcodes[0x137].tCycles == 8 );
+
+    uint64_t microOperationCycles = 0;
+    for( const auto& counter: profile.microOperations )
+        microOperationCycles += counter.tCycles;
+    REQUIRE( microOperationCycles == tCycles );
+    REQUIRE( profile.toCsv().contains( "opcode,0xCB 0x37,1,8" ) );
+    REQUIRE( profile.toJson().contains( "\"microOperations\"" ) );
+}
+#endif
@@ -0,0 +1,31 @@
+#include "core/core_constants.hpp"
+#include "core/emulator.hpp"
+#include "dummy_types.hpp"
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <memory>
+
+// Hidden, run with: test_core "[benchmark]"
+TEST_CASE( "Micro-operation dispatch", "[.][benchmark][cpu]" ) {
+    Emulator<DummyPpu, DummyCpu, Flat64KMemory> emu( std::make_unique<DummyCartridge>(), dummyJoypadHandler );
+    // Loop mixing loads, ALU, CB prefixed, stack and control flow micro-operations:
+    // LD HL, 0xC100; LD B, 0; loop: LD A, (HL); ADD A, B; RLCA; XOR 0x5A; LD (HL+), A; SWAP A; BIT 3, A;
+    // PUSH BC; POP DE; CALL 0xC020; DEC B; JR NZ, loop; JR 0xC000
+    const uint8_t code[] = { 0x21, 0x00, 0xC1, 0x06, 0x00, 0x7E, 0x80, 0x07, 0xEE, 0x5A, 0x22, 0xCB,
+                             0x37, 0xCB, 0x5F, 0xC5, 0xD1, 0xCD, 0x20, 0xC0, 0x05, 0x20, 0xEE, 0x18, 0xE7 };
+    // 0xC020: INC C; RET
+    const uint8_t subroutine[] = { 0x0C, 0xC9 };
+    for( uint16_t i = 0; i < sizeof( code ); i++ )
+        emu.directMemWrite( static_cast<uint16_t>( addr::workRam00 + i ), code[i] );
+    for( uint16_t i = 0; i < sizeof( subroutine ); i++ )
+        emu.directMemWrite( static_cast<uint16_t>( addr::workRam00 + 0x20 + i ), subroutine[i] );
+    emu.cpu.PC = addr::workRam00;
+
+    BENCHMARK( "100000 M-cycles of the micro-operation Cpu" ) {
+        unsigned tCycles = 0;
+        for( unsigned i = 0; i < 100000; i++ )
+            tCycles += emu.cpu.tick();
+        return tCycles;
+    };
+}
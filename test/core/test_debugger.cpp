@@ -0,0 +1,118 @@
+#include "core/core_constants.hpp"
+#include "core/debugger.hpp"
+#include "core/emulator.hpp"
+#include "core/fast_cpu.hpp"
+#include "core/memory.hpp"
+#include "dummy_types.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <memory>
+
+namespace {
+template<typename Tcpu>
+class DebuggedCpu : public Tcpu {
+public:
+    using Tcpu::PC;
+    using Tcpu::Tcpu;
+};
+
+template<typename Tcpu, typename Tmemory = Flat64KMemory>
+using DebuggedEmulator = Emulator<DummyPpu, DebuggedCpu<Tcpu>, Tmemory, Debugger>;
+
+// LD A, 5; LD (0xD000), A; INC A; LD A, (0xD000); JR back to the start
+template<typename Tcpu, typename Tmemory>
+void loadProgram( DebuggedEmulator<Tcpu, Tmemory>& emu ) {
+    const uint8_t program[] = { 0x3E, 0x05, 0xEA, 0x00, 0xD0, 0x3C, 0xFA, 0x00, 0xD0, 0x18, 0xF5 };
+    for( uint16_t i = 0; i < sizeof( program ); i++ )
+        emu.directMemWrite( static_cast<uint16_t>( addr::workRam00 + i ), program[i] );
+    emu.directMemWrite( addr::lcdControl, 0 );
+    emu.directMemWrite( addr::interruptEnableRegister, 0 );
+    emu.cpu.PC = addr::workRam00;
+}
+
+template<typename Tcpu, typename Tmemory>
+void runUntilStopped( DebuggedEmulator<Tcpu, Tmemory>& emu ) {
+    for( int i = 0; i < 1000 && ! emu.debugger.stopped(); i++ )
+        emu.tick();
+    REQUIRE( emu.debugger.stopped() );
+}
+
+template<typename Tcpu>
+void checkBreakpoints() {
+    DebuggedEmulator<Tcpu> emu( std::make_unique<DummyCartridge>(), dummyJoypadHandler );
+    loadProgram( emu );
+    emu.debugger.setBreakpoint( 0xC005 );
+
+    runUntilStopped( emu );
+    REQUIRE( emu.debugger.stopReason()->reason == Debugger::Reason_t::BREAKPOINT );
+    REQUIRE( emu.cpu.getPC() == 0xC005 );
+    REQUIRE( emu.cpu.readR8( Cpu::Operand_t::a ) == 5 );
+    REQUIRE( emu.tick() == 0 );
+
+    emu.debugger.step();
+    runUntilStopped( emu );
+    REQUIRE( emu.debugger.stopReason()->reason == Debugger::Reason_t::PAUSE );
+    REQUIRE( emu.cpu.getPC() == 0xC006 );
+    REQUIRE( emu.cpu.readR8( Cpu::Operand_t::a ) == 6 );
+
+    // Next iteration of the loop
+    emu.debugger.resume();
+    runUntilStopped( emu );
+    REQUIRE( emu.debugger.stopReason()->reason == Debugger::Reason_t::BREAKPOINT );
+    REQUIRE( emu.cpu.getPC() == 0xC005 );
+}
+
+template<typename Tcpu>
+void checkWatchpoints() {
+    DebuggedEmulator<Tcpu> emu( std::make_unique<DummyCartridge>(), dummyJoypadHandler );
+    loadProgram( emu );
+    // Same page, never accessed
+    emu.debugger.setWatchpoint( 0xD001, Debugger::WRITE );
+    emu.debugger.setWatchpoint( 0xD000, Debugger::WRITE );
+
+    runUntilStopped( emu );
+    REQUIRE( emu.debugger.stopReason()->reason == Debugger::Reason_t::WRITE_WATCHPOINT );
+    REQUIRE( emu.debugger.stopReason()->address == 0xD000 );
+    REQUIRE( emu.debugger.stopReason()->value == 5 );
+    REQUIRE( emu.directMemRead( 0xD000 ) == 5 );
+
+    emu.debugger.setWatchpoint( 0xD000, Debugger::WRITE, false );
+    emu.debugger.setWatchpoint( 0xD000, Debugger::READ );
+    emu.debugger.resume();
+    runUntilStopped( emu );
+    REQUIRE( emu.debugger.stopReason()->reason == Debugger::Reason_t::READ_WATCHPOINT );
+    REQUIRE( emu.debugger.stopReason()->value == 5 );
+}
+
+// Memory has page tables, so until the debugger is armed instructions are fetched through the CPU's window
+template<typename Tcpu>
+void checkFetchWatchpoints() {
+    DebuggedEmulator<Tcpu, Memory> emu( std::make_unique<DummyCartridge>(), dummyJoypadHandler );
+    loadProgram( emu );
+    for( int i = 0; i < 100; i++ )
+        emu.tick();
+    REQUIRE_FALSE( emu.debugger.stopped() );
+
+    // Operand of JR, only read by the instruction fetch
+    emu.debugger.setWatchpoint( 0xC00A, Debugger::READ );
+    runUntilStopped( emu );
+    REQUIRE( emu.debugger.stopReason()->reason == Debugger::Reason_t::READ_WATCHPOINT );
+    REQUIRE( emu.debugger.stopReason()->address == 0xC00A );
+    REQUIRE( emu.debugger.stopReason()->value == 0xF5 );
+}
+} // namespace
+
+TEST_CASE( "Breakpoints stop before the instruction and stepping executes one", "[debugger]" ) {
+    checkBreakpoints<Cpu>();
+    checkBreakpoints<FastCpu>();
+}
+
+TEST_CASE( "Watchpoints stop on accesses of the watched address", "[debugger]" ) {
+    checkWatchpoints<Cpu>();
+    checkWatchpoints<FastCpu>();
+}
+
+TEST_CASE( "Watchpoints see instruction fetches from a page fetched before", "[debugger]" ) {
+    checkFetchWatchpoints<Cpu>();
+    checkFetchWatchpoints<FastCpu>();
+}
@@ -0,0 +1,210 @@
+#include "core/cartridge.hpp"
+#include "core/core_constants.hpp"
+#include "core/memory.hpp"
+#include "dummy_types.hpp"
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+// 64 KiB ROM, every byte of a bank holds its number. Writes to 0x2000-0x3FFF select the 0x4000-0x7FFF bank,
+// 0x0A written below 0x2000 enables the 8 KiB RAM.
+class SwitchableCartridge final : public CoreCartridge {
+    static std::vector<uint8_t> makeRom() {
+        std::vector<uint8_t> rom( 4 * 0x4000 );
+        for( std::size_t i = 0; i < rom.size(); i++ )
+            rom[i] = static_cast<uint8_t>( i / 0x4000 );
+        rom[addr::romSize] = 0x01;
+        rom[addr::ramSize] = 0x02;
+        return rom;
+    }
+
+public:
+    unsigned bank   = 1;
+    bool ramEnabled = false;
+    unsigned reads  = 0;
+
+    void updateBanks() {
+        mapBanks( romBankData( 0 ), romBankData( bank ), ramEnabled ? ramBankData( 0 ) : nullptr );
+    }
+    uint8_t read( const uint16_t address ) override {
+        reads++;
+        if( address >= addr::externalRam )
+            return ramEnabled ? ramBanks[0][address - addr::externalRam] : 0xFF;
+        return romBanks[mappedRomBank( address )][address & 0x3FFF];
+    }
+    void write( const uint16_t address, const uint8_t value ) override {
+        if( address < 0x2000 )
+            ramEnabled = value == 0x0A;
+        else if( address < 0x4000 )
+            bank = value;
+        updateBanks();
+    }
+    unsigned mappedRomBank( const uint16_t address ) const override {
+        return address < 0x4000 ? 0 : bank;
+    }
+    uint8_t ram( const uint16_t offset ) const {
+        return ramBanks[0][offset];
+    }
+    SwitchableCartridge() : CoreCartridge( makeRom() ) {
+        updateBanks();
+    }
+};
+} // namespace
+
+TEST_CASE( "Memory pages map RAM mirrors and the high page", "[memory]" ) {
+    SwitchableCartridge cartridge;
+    Memory memory( &cartridge );
+
+    memory.write( 0xC123, 0x11 );
+    memory.write( 0xDD00, 0x22 );
+    REQUIRE( memory.read( 0xE123 ) == 0x11 );
+    REQUIRE( memory.read( 0xFD00 ) == 0x22 );
+    memory.write( 0xF000, 0x33 );
+    REQUIRE( memory.read( 0xD000 ) == 0x33 );
+
+    memory.write( 0xFF80, 0x44 );
+    memory.write( addr::interruptEnableRegister, 0x1F );
+    REQUIRE( memory.read( 0xFF80 ) == 0x44 );
+    REQUIRE( memory.read( addr::interruptEnableRegister ) == 0x1F );
+    REQUIRE( memory.ramSpan( 0xFF80 ).size() == 127 );
+
+    // Not usable area ignores writes
+    memory.write( 0xFEA0, 0x55 );
+    REQUIRE( memory.read( 0xFEA0 ) == 0 );
+}
+
+TEST_CASE( "Memory pages follow ROM bank switches", "[memory]" ) {
+    SwitchableCartridge cartridge;
+    Memory memory( &cartridge );
+    const unsigned readsBefore = cartridge.reads;
+
+    REQUIRE( memory.read( 0x0100 ) == 0 );
+    REQUIRE( memory.read( 0x4000 ) == 1 );
+    memory.write( 0x2000, 3 );
+    REQUIRE( memory.read( 0x7FFF ) == 3 );
+    REQUIRE( memory.read( 0x3FFF ) == 0 );
+    // Reads were served from the pages
+    REQUIRE( cartridge.reads == readsBefore );
+}
+
+TEST_CASE( "Memory maps external RAM only while the cartridge enables it", "[memory]" ) {
+    SwitchableCartridge cartridge;
+    Memory memory( &cartridge );
+    const unsigned readsBefore = cartridge.reads;
+
+    // Disabled RAM goes through the cartridge
+    REQUIRE( memory.read( addr::externalRam ) == 0xFF );
+    REQUIRE( cartridge.reads == readsBefore + 1 );
+
+    memory.write( 0x0000, 0x0A );
+    memory.write( 0xBFFF, 0x42 );
+    REQUIRE( cartridge.ram( 0x1FFF ) == 0x42 );
+    REQUIRE( memory.read( 0xBFFF ) == 0x42 );
+    REQUIRE( cartridge.reads == readsBefore + 1 );
+
+    memory.write( 0x0000, 0x00 );
+    REQUIRE( memory.read( 0xBFFF ) == 0xFF );
+    REQUIRE( cartridge.reads == readsBefore + 2 );
+}
+
+TEST_CASE( "IO register writes are dispatched to their component", "[memory]" ) {
+    Emulator<DummyPpu> emu( std::make_unique<DummyCartridge>(), dummyJoypadHandler );
+
+    emu.write( addr::divider, 0x12 );
+    REQUIRE( emu.read( addr::divider ) == 0 );
+    emu.write( addr::interruptFlag, bitMask::timerInterrupt );
+    emu.write( addr::interruptEnableRegister, bitMask::timerInterrupt | bitMask::vBlankInterrupt );
+    REQUIRE( emu.interrupts.pending() == bitMask::timerInterrupt );
+
+    emu.write( addr::lyc, 5 );
+    emu.write( addr::lcdY, 5 );
+    REQUIRE( ( emu.read( addr::lcdStatus ) & ( 1 << 2 ) ) );
+    emu.write( addr::lcdY, 6 );
+    REQUIRE_FALSE( ( emu.read( addr::lcdStatus ) & ( 1 << 2 ) ) );
+
+    // No side effects
+    emu.write( addr::bgPalette, 0xE4 );
+    REQUIRE( emu.read( addr::bgPalette ) == 0xE4 );
+}
+
+TEST_CASE( "OAM DMA copies at once and leaves only the high page to the CPU", "[memory]" ) {
+    Emulator<DummyPpu, DummyCpu> emu( std::make_unique<DummyCartridge>(), dummyJoypadHandler );
+    for( uint16_t i = 0; i < size::oam; i++ )
+        emu.directMemWrite( static_cast<uint16_t>( 0xC100 + i ), static_cast<uint8_t>( i + 1 ) );
+    // JR -2 in high RAM, as DMA routines wait there
+    emu.directMemWrite( 0xFF90, 0x18 );
+    emu.directMemWrite( 0xFF91, 0xFE );
+    emu.cpu.PC = 0xFF90;
+
+    emu.write( addr::oamDma, 0xC1 );
+    REQUIRE( emu.directMemRead( addr::objectAttributeMemory ) == 1 );
+    REQUIRE( emu.directMemRead( addr::objectAttributeMemory + size::oam - 1 ) == size::oam );
+    REQUIRE( emu.read( 0xC100 ) == 0xFF );
+    emu.write( 0xC100, 0x55 );
+    REQUIRE( emu.directMemRead( 0xC100 ) == 1 );
+    emu.write( 0xFF80, 0x66 );
+    REQUIRE( emu.read( 0xFF80 ) == 0x66 );
+
+    unsigned tCycles = 0;
+    while( tCycles < constant::oamDmaDuration ) {
+        REQUIRE( emu.read( 0xC100 ) == 0xFF );
+        tCycles += emu.tick();
+    }
+    REQUIRE( emu.read( 0xC100 ) == 1 );
+    REQUIRE( emu.cpu.getPC() == 0xFF90 );
+}
+
+TEST_CASE( "Locked VRAM and OAM pages are only hidden from the bus", "[memory]" ) {
+    SwitchableCartridge cartridge;
+    Memory memory( &cartridge );
+    memory.write( 0x8000, 0x12 );
+    memory.write( 0xFE00, 0x34 );
+
+    memory.setVramLock( true );
+    memory.setOamLock( true );
+    REQUIRE( memory.busRead( 0x8000 ) == 0xFF );
+    REQUIRE( memory.busRead( 0xFE00 ) == 0xFF );
+    REQUIRE( memory.read( 0x8000 ) == 0x12 );
+    memory.busWrite( 0x8000, 0x56 );
+    memory.busWrite( 0xFE00, 0x78 );
+    REQUIRE( memory.read( 0x8000 ) == 0x12 );
+    REQUIRE( memory.read( 0xFE00 ) == 0x34 );
+
+    memory.setVramLock( false );
+    memory.setOamLock( false );
+    memory.busWrite( 0x8000, 0x56 );
+    memory.busWrite( 0xFE00, 0x78 );
+    REQUIRE( memory.busRead( 0x8000 ) == 0x56 );
+    REQUIRE( memory.busRead( 0xFE00 ) == 0x78 );
+}
+
+#ifdef BUS_PROFILING
+TEST_CASE( "Bus heatmap counts accesses per page and requester", "[memory][profiling]" ) {
+    Emulator<DummyPpu, DummyCpu> emu( std::make_unique<DummyCartridge>(), dummyJoypadHandler );
+    // NOPs in high RAM, reachable during OAM DMA
+    emu.cpu.PC = addr::highRam;
+    emu.resetBusHeatmap();
+
+    emu.write( addr::oamDma, 0xC1 );
+    unsigned tCycles = 0;
+    while( tCycles < 40 )
+        tCycles += emu.tick();
+    const auto& pages = emu.busHeatmap().pages;
+    REQUIRE( pages[BusHeatmap::CPU][0xFF].writes == 1 );
+    REQUIRE( pages[BusHeatmap::CPU][0xFF].reads >= 9 );
+    REQUIRE( pages[BusHeatmap::DMA][0xC1].reads == size::oam );
+    REQUIRE( pages[BusHeatmap::DMA][0xFE].writes == size::oam );
+    REQUIRE( pages[BusHeatmap::PPU][0xFF].reads > 0 );
+    REQUIRE( pages[BusHeatmap::TIMER][0xFF].reads > 0 );
+    REQUIRE( pages[BusHeatmap::TIMER][0xC0].reads == 0 );
+
+    const std::string csv = emu.busHeatmap().toCsv();
+    REQUIRE( csv.starts_with( "page,cpu_reads,cpu_writes,ppu_reads" ) );
+    REQUIRE( std::count( csv.begin(), csv.end(), '\n' ) == 257 );
+}
+#endif
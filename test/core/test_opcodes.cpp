@@ -1,4 +1,9 @@
+#include "core/cached_cpu.hpp"
 #include "core/emulator.hpp"
+#include "core/fast_cpu.hpp"
+#ifdef JIT_X86_64
+#include "core/jit_cpu.hpp"
+#endif
 #include "core/logging.hpp"
 #include "dummy_types.hpp"
 #include <catch2/catch_test_macros.hpp>
@@ -11,20 +16,6 @@
 using json                     = nlohmann::json;
 using ramAddressValueMapping_t = std::map<uint16_t, uint8_t>;
 
-class Flat64KMemory {
-    uint8_t memory[64 * 1024];
-
-public:
-    uint8_t read( const uint16_t index ) const {
-        return memory[index];
-    }
-    void write( const uint16_t index, uint8_t value ) {
-        memory[index] = value;
-    }
-    Flat64KMemory( [[maybe_unused]] CoreCartridge* cartridge_ ) {
-    }
-};
-
 struct CpuState {
     uint8_t a, b, c, d, e, f, h, l;
     uint16_t pc, sp;
@@ -52,8 +43,21 @@ CpuState parseState( const json& state_json ) {
     return state;
 }
 
-class TestCpu final : public Cpu {
+template<typename Tcpu>
+class TestCpu final : public Tcpu {
+    using Tcpu::bus;
+    using Tcpu::PC;
+    using Tcpu::SP;
+    using Tcpu::mopQueue;
+    using Tcpu::atMicroOperationNr;
+    using Tcpu::halted;
+    using Tcpu::emptyMopQueue;
+    using Operand_t = typename Tcpu::Operand_t;
+
 public:
+    using Tcpu::readR8;
+    using Tcpu::writeR8;
+
     void setCpuState( const CpuState& state ) {
         writeR8( Operand_t::a, state.a );
         writeR8( Operand_t::b, state.b );
@@ -66,8 +70,13 @@ public:
         PC = state.pc;
         SP = state.sp;
 
+        // Through the bus, so the timer sees DIV resets, except the DMA register. Writing it would start
+        // OAM DMA, which overwrites OAM and locks the bus for the following tests.
         for( const auto& [address, value]: state.ram ) {
-            bus.write( address, value );
+            if( address == addr::oamDma )
+                bus.directMemWrite( address, value );
+            else
+                bus.write( address, value );
         }
     }
 
@@ -92,12 +101,21 @@ public:
     }
 
     void clearMopQueue() {
-        mopQueue           = { MicroOperationType_t::END };
+        mopQueue           = emptyMopQueue;
         atMicroOperationNr = 0;
+        halted             = false; // HALT of a previous test
+        // Tests rewrite ROM, which never happens on hardware
+        if constexpr( requires { this->flushBlocks(); } )
+            this->flushBlocks();
     }
 
-    TestCpu( IBus& bus_ ) : Cpu( bus_ ) {
-        mopQueue = { MicroOperationType_t::END };
+    TestCpu( IBus& bus_ ) : Tcpu( bus_ ) {
+        mopQueue = emptyMopQueue;
+        // Compile every tested instruction alone
+        if constexpr( requires { this->hotThreshold; } ) {
+            this->hotThreshold      = 1;
+            this->maxCompiledLength = 1;
+        }
     }
 };
 
@@ -176,8 +194,10 @@ bool checkCpuState( const CpuState& expected, const CpuState& actual ) {
     return passed;
 }
 
-TEST_CASE( "CPU opcodes", "[cpu][opcodes]" ) {
-    Emulator<DummyPpu, TestCpu, Flat64KMemory> emu( std::make_unique<DummyCartridge>(), dummyJoypadHandler );
+// Micro-operation Cpu ticks once per M-cycle, FastCpu and derived execute whole instruction in one tick
+template<typename Tcpu>
+void runOpcodeTests( const bool instructionGranular ) {
+    Emulator<DummyPpu, TestCpu<Tcpu>, Flat64KMemory> emu( std::make_unique<DummyCartridge>(), dummyJoypadHandler );
 
     for( const auto& entry: std::filesystem::directory_iterator( OPCODE_TESTS_PATH ) ) {
         std::ifstream file( entry.path() );
@@ -197,12 +217,18 @@ TEST_CASE( "CPU opcodes", "[cpu][opcodes]" ) {
             std::string testName = test.contains( "name" ) ? test["name"].get<std::string>() : "unnamed";
             std::string context =
                     "File: " + filename + ", Test #" + std::to_string( testIndex ) + " (" + testName + ")";
-
             INFO( context );
             emu.cpu.setCpuState( parseState( test["initial"] ) );
             emu.cpu.clearMopQueue();
-            for( unsigned i = 0; i < getCycles( opcode, true ) / 4; i++ ) {
-                emu.tick();
+            if( instructionGranular ) {
+                const unsigned ticks = emu.tick();
+                // Every element of "cycles" is one M-cycle
+                if( test.contains( "cycles" ) )
+                    CHECK( ticks == test["cycles"].size() * 4 );
+            } else {
+                for( unsigned i = 0; i < getCycles( opcode, true ) / 4; i++ ) {
+                    emu.tick();
+                }
             }
 
             const CpuState expectedState = parseState( test["final"] );
@@ -218,3 +244,21 @@ TEST_CASE( "CPU opcodes", "[cpu][opcodes]" ) {
         }
     }
 }
+
+TEST_CASE( "CPU opcodes", "[cpu][opcodes]" ) {
+    runOpcodeTests<Cpu>( false );
+}
+
+TEST_CASE( "Fast CPU opcodes", "[cpu][opcodes]" ) {
+    runOpcodeTests<FastCpu>( true );
+}
+
+TEST_CASE( "Cached CPU opcodes", "[cpu][opcodes]" ) {
+    runOpcodeTests<CachedCpu>( true );
+}
+
+#ifdef JIT_X86_64
+TEST_CASE( "JIT CPU opcodes", "[cpu][opcodes]" ) {
+    runOpcodeTests<JitCpu>( true );
+}
+#endif
@@ -0,0 +1,82 @@
+#include "core/core_constants.hpp"
+#include "core/emulator.hpp"
+#include "core/pc_sampler.hpp"
+#include "dummy_types.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+constexpr char symFile[] = "; File generated by rgblink\n"
+                           "00:c000 Main\n"
+                           "00:c010 Busy\n"
+                           "00:c012 Busy.loop\n"
+                           "01:4000 BankedRoutine\n";
+
+TEST_CASE( "Symbol table resolves locations to the enclosing function", "[profiling][sampler]" ) {
+    const SymbolTable symbols( symFile );
+    REQUIRE( symbols.size() == 3 );
+    REQUIRE( symbols.nameOf( { 0, 0xC000 } ) == "Main" );
+    REQUIRE( symbols.nameOf( { 0, 0xC013 } ) == "Busy" );
+    REQUIRE( symbols.nameOf( { 1, 0x4100 } ) == "BankedRoutine" );
+    REQUIRE( symbols.nameOf( { 2, 0x4100 } ) == "02:4100" );
+}
+
+TEST_CASE( "Sampled PCs are attributed to functions and their callers", "[profiling][sampler]" ) {
+    Emulator<DummyPpu, DummyCpu, Flat64KMemory> emu( std::make_unique<DummyCartridge>(), dummyJoypadHandler );
+    // Main: CALL Busy; JR Main
+    // Busy: LD B, 32; .loop: DEC B; JR NZ, .loop; RET
+    const uint8_t main[] = { 0xCD, 0x10, 0xC0, 0x18, 0xFB };
+    const uint8_t busy[] = { 0x06, 0x20, 0x05, 0x20, 0xFD, 0xC9 };
+    for( uint16_t i = 0; i < sizeof( main ); i++ )
+        emu.directMemWrite( static_cast<uint16_t>( addr::workRam00 + i ), main[i] );
+    for( uint16_t i = 0; i < sizeof( busy ); i++ )
+        emu.directMemWrite( static_cast<uint16_t>( addr::workRam00 + 0x10 + i ), busy[i] );
+    // Words above the stack are scanned for return addresses too
+    for( uint16_t address = 0xDF00; address < 0xE100; address++ )
+        emu.directMemWrite( address, 0 );
+    emu.directMemWrite( addr::lcdControl, 0 );
+    emu.cpu.PC = addr::workRam00;
+    emu.cpu.writeR16( Cpu::Operand_t::sp, 0xDFFE );
+
+    constexpr std::size_t capacity = 256;
+    emu.sampler.start( 52, capacity );
+    for( int i = 0; i < 100000; i++ )
+        emu.tick();
+    const auto samples = emu.sampler.samples();
+    REQUIRE( samples.size() == capacity );
+    REQUIRE( emu.sampler.droppedSamples() > 0 );
+
+    const SymbolTable symbols( symFile );
+    const std::string flat      = flatProfile( samples, symbols );
+    const std::string collapsed = collapsedStacks( samples, symbols );
+    // Busy takes most of the time and is only called by Main
+    REQUIRE( flat.find( "Busy" ) < flat.find( "Main" ) );
+    REQUIRE( collapsed.contains( "Main;Busy " ) );
+    REQUIRE_FALSE( collapsed.contains( "Busy;" ) );
+}
+
+TEST_CASE( "Skipped HALT cycles are sampled every period", "[profiling][sampler]" ) {
+    Emulator<DummyPpu, DummyCpu, Flat64KMemory> emu( std::make_unique<DummyCartridge>(), dummyJoypadHandler );
+    // HALT with no interrupt enabled, every tick skips a whole cycle budget
+    emu.directMemWrite( addr::workRam00, 0x76 );
+    emu.directMemWrite( addr::interruptEnableRegister, 0 );
+    emu.directMemWrite( addr::lcdControl, 0 );
+    emu.directMemWrite( addr::timerControl, 0 );
+    emu.cpu.PC = addr::workRam00;
+    emu.cpu.writeR16( Cpu::Operand_t::sp, 0xDFFE );
+
+    while( ! emu.cpu.waitsForInterrupt() )
+        emu.tick();
+
+    constexpr unsigned period = 52;
+    emu.sampler.start( period, 1 << 16 );
+    unsigned tCycles = 0;
+    for( int i = 0; i < 10; i++ ) {
+        const unsigned ticked = emu.tick( constant::frameDuration );
+        REQUIRE( ticked > 100 * period );
+        tCycles += ticked;
+    }
+    REQUIRE( emu.sampler.samples().size() == tCycles / period );
+    REQUIRE( emu.sampler.droppedSamples() == 0 );
+}
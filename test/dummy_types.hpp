@@ -5,6 +5,7 @@
 #include "core/emulator.hpp"
 #include "core/ppu.hpp"
 #include <cstdint>
+#include <span>
 
 class DummyCartridge final : public CoreCartridge {
     friend class Tester;
@@ -23,6 +24,7 @@ class DummyCpu final : public Cpu {
     friend class Tester;
 
 public:
+    using Cpu::atMicroOperationNr;
     using Cpu::mopQueue;
     using Cpu::PC;
     using Cpu::registers;
@@ -61,6 +63,39 @@ public:
     }
     void directMemWrite( [[maybe_unused]] uint16_t address, [[maybe_unused]] uint8_t value ) override {
     }
+    unsigned mappedRomBank( [[maybe_unused]] uint16_t address ) const override {
+        return 0;
+    }
+    unsigned cyclesUntilInterruptRequest() const override {
+        return 0;
+    }
+};
+
+class Flat64KMemory {
+    uint8_t memory[64 * 1024];
+
+public:
+    uint8_t read( const uint16_t index ) const {
+        return memory[index];
+    }
+    void write( const uint16_t index, uint8_t value ) {
+        memory[index] = value;
+    }
+    // Regions of Memory::ramSpan(), with both work RAM banks and their echo contiguous
+    std::span<uint8_t> ramSpan( const uint16_t index ) {
+        uint32_t regionEnd = 0;
+        if( addr::videoRam <= index && index < addr::externalRam )
+            regionEnd = addr::externalRam;
+        else if( addr::workRam00 <= index && index < addr::objectAttributeMemory )
+            regionEnd = addr::objectAttributeMemory;
+        else if( addr::highRam <= index && index < addr::interruptEnableRegister )
+            regionEnd = addr::interruptEnableRegister;
+        if( ! regionEnd )
+            return {};
+        return std::span( memory ).subspan( index, regionEnd - index );
+    }
+    Flat64KMemory( [[maybe_unused]] CoreCartridge* cartridge_ ) {
+    }
 };
 
 inline void dummyJoypadHandler( [[maybe_unused]] IBus& ) {